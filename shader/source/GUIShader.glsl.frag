@@ -1,36 +1,44 @@
 #version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout ( location = 0 ) in flat int i_instanceIndex;
 layout ( location = 1 ) in vec2 i_textureCoordinates;
 
 layout ( location = 0 ) out vec4 o_color;
 
+// Set per pipeline, see Recterer::CreatePipeline
+layout ( constant_id = 0 ) const bool c_textured = true;
+layout ( constant_id = 1 ) const bool c_bordered = true;
+
 struct InstanceData
 {
 	vec4 color;
 	vec4 borderColor;
 	vec4 borderSize;
+	uint textureIndex;
 };
 
-layout ( set = 0, binding = 2 ) uniform InstanceDatasBlock
+layout ( std430, set = 0, binding = 2 ) readonly buffer InstanceDatasBlock
 {
-	InstanceData instanceDatas [ 10000 ];
+	InstanceData instanceDatas [];
 }
 instanceDatas;
 
-layout ( set = 1, binding = 0 ) uniform sampler samp;
-layout ( set = 1, binding = 1 ) uniform texture2D tex;
+layout ( set = 0, binding = 4 ) uniform sampler samp;
+layout ( set = 0, binding = 5 ) uniform texture2D textures [];
 
 void main ()
 {
 	InstanceData instanceData = instanceDatas.instanceDatas [ i_instanceIndex ];
 
 	o_color = instanceData.color;
-	o_color *= texture ( sampler2D ( tex, samp ), i_textureCoordinates );
+
+	if ( c_textured )
+		o_color *= texture ( sampler2D ( textures [ nonuniformEXT ( instanceData.textureIndex ) ], samp ), i_textureCoordinates );
 
 	// Render border
-	if ( 
+	if ( c_bordered && (
 		( i_textureCoordinates.x <= instanceData.borderSize.x || i_textureCoordinates.x >= ( 1 - instanceData.borderSize.y ) )
-		|| ( i_textureCoordinates.y <= instanceData.borderSize.z || i_textureCoordinates.y >= ( 1 - instanceData.borderSize.w ) ) )
+		|| ( i_textureCoordinates.y <= instanceData.borderSize.z || i_textureCoordinates.y >= ( 1 - instanceData.borderSize.w ) ) ) )
 			o_color = instanceData.borderColor;
 }
\ No newline at end of file
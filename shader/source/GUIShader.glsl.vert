@@ -12,21 +12,21 @@ layout ( set = 0, binding = 0 ) uniform CameraBlock
 }
 camera;
 
-layout ( set = 0, binding = 1 ) uniform InstanceTransformsBlock
+layout ( std430, set = 0, binding = 1 ) readonly buffer InstanceTransformsBlock
 {
-	mat4 transforms [ 10000 ];
+	mat4 transforms [];
 }
 instanceTransforms;
 
-layout ( set = 1, binding = 2 ) uniform InstanceIndicesBlock
+layout ( std430, set = 0, binding = 3 ) readonly buffer InstanceIndicesBlock
 {
-	vec4 indices [10000];
+	uint indices [];
 }
 instanceIndices;
 
 void main ()
 {
-	int instanceIndex = int ( instanceIndices.indices [ gl_InstanceIndex ].x );
+	int instanceIndex = int ( instanceIndices.indices [ gl_InstanceIndex ] );
 
 	gl_Position = camera.projectionMatrix * instanceTransforms.transforms[instanceIndex] * vec4 ( i_position, 0.0f, 1.0f );
 	o_instanceIndex = instanceIndex;
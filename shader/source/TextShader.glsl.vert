@@ -3,7 +3,15 @@
 layout ( location = 0 ) in vec2 i_position;
 layout ( location = 1 ) in vec2 i_textureCoordinates;
 
+// Per glyph instance
+layout ( location = 2 ) in vec2 i_glyphPosition;
+layout ( location = 3 ) in vec2 i_glyphSize;
+// Offset and scale of the glyph within its atlas page
+layout ( location = 4 ) in vec4 i_uvRect;
+layout ( location = 5 ) in vec4 i_color;
+
 layout ( location = 0 ) out vec2 o_textureCoordinates;
+layout ( location = 1 ) out vec4 o_color;
 
 layout ( set = 0, binding = 0 ) uniform CameraBlock
 {
@@ -11,14 +19,9 @@ layout ( set = 0, binding = 0 ) uniform CameraBlock
 }
 camera;
 
-layout ( push_constant ) uniform PushConstantBlock
-{
-	layout ( offset = 0 ) mat4 transform;
-}
-pushConstants;
-
 void main ()
 {
-	gl_Position = camera.projection * pushConstants.transform * vec4 ( i_position, 0.0f, 1.0f );
-	o_textureCoordinates = i_textureCoordinates;
+	gl_Position = camera.projection * vec4 ( i_glyphPosition + i_position * i_glyphSize, 0.0f, 1.0f );
+	o_textureCoordinates = i_uvRect.xy + i_textureCoordinates * i_uvRect.zw;
+	o_color = i_color;
 }
\ No newline at end of file
@@ -1,26 +1,47 @@
 #version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout ( location = 0 ) in vec2 i_textureCoordinates;
+layout ( location = 1 ) flat in uint i_object;
 
 layout ( location = 0 ) out vec4 o_color;
 
-layout ( set = 1, binding = 0 ) uniform MaterialBlock
+struct Material
 {
 	vec4 ambientColor;
 	vec4 diffuseColor;
 	vec4 specularColor;
-}
-material;
+};
 
+layout ( set = 1, binding = 0, std430 ) readonly buffer MaterialBlock
+{
+	Material materials [];
+};
+
+struct Object
+{
+	uint material;
+
+	// Ambient, diffuse and specular
+	uint textures [ 3 ];
+};
+
+layout ( set = 1, binding = 1, std430 ) readonly buffer ObjectBlock
+{
+	Object objects [];
+};
+
+// Every texture of the scene
 layout ( set = 2, binding = 0 ) uniform sampler u_sampler;
-layout ( set = 2, binding = 1 ) uniform texture2D u_ambientTexture;
-layout ( set = 2, binding = 2 ) uniform texture2D u_diffuseTexture;
-layout ( set = 2, binding = 3 ) uniform texture2D u_specularTexture;
+layout ( set = 2, binding = 1 ) uniform texture2D u_textures [];
 
 void main ()
 {
-	vec3 ambient = material.ambientColor.xyz * texture ( sampler2D ( u_ambientTexture, u_sampler ), i_textureCoordinates ).rgb * 0.1f;
-	vec3 diffuse = material.diffuseColor.xyz * texture ( sampler2D ( u_diffuseTexture, u_sampler ), i_textureCoordinates ).rgb * 1.0f;
+	Object object = objects [ i_object ];
+	Material material = materials [ object.material ];
+
+	vec3 ambient = material.ambientColor.xyz * texture ( sampler2D ( u_textures [ nonuniformEXT ( object.textures [ 0 ] ) ], u_sampler ), i_textureCoordinates ).rgb * 0.1f;
+	vec3 diffuse = material.diffuseColor.xyz * texture ( sampler2D ( u_textures [ nonuniformEXT ( object.textures [ 1 ] ) ], u_sampler ), i_textureCoordinates ).rgb * 1.0f;
 
 	//o_color = vec4 ( 1, 1, 1, 1 );
 	o_color = vec4 ( ambient + diffuse, 1.0 );
@@ -4,6 +4,7 @@ layout ( location = 0 ) in vec3 i_position;
 layout ( location = 1 ) in vec2 i_textureCoordinates;
 
 layout ( location = 0 ) out vec2 o_textureCoordinates;
+layout ( location = 1 ) flat out uint o_object;
 
 layout ( set = 0, binding = 0 ) uniform CameraBlock
 {
@@ -16,4 +17,7 @@ void main ()
 {
 	gl_Position = camera.projectionMatrix * camera.viewMatrix * vec4 ( i_position, 1.0f );
 	o_textureCoordinates = i_textureCoordinates;
-}
\ No newline at end of file
+
+	// Every draw's first instance is its object's index
+	o_object = gl_InstanceIndex;
+}
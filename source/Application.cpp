@@ -12,8 +12,10 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE;
 
 namespace pd
 {
-	Application::Application ()
+	Application::Application ( uint32_t framesInFlight ) : framesInFlight { framesInFlight }
 	{
+		auto startupStart { std::chrono::steady_clock::now () };
+
 		SDL_Init ( 0 );
 		window = SDL_CreateWindow ( "Palladium", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 720, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE );
 
@@ -43,23 +45,40 @@ namespace pd
 		auto windowSize { GetWindowSize ( window ) };
 		swapchain = CreateSwapchain ( physicalDevice, device, surface, surfaceFormat, windowSize );
 		swapchainExtent = vk::Extent2D { static_cast < uint32_t > ( windowSize.x ), static_cast < uint32_t > ( windowSize.y ) };
-		renderPass = CreateRenderPass ( device, surfaceFormat.format );
+		sceneRenderPass = CreateRenderPass ( device, surfaceFormat.format, RenderPassStage::scene );
+		overlayRenderPass = CreateRenderPass ( device, surfaceFormat.format, RenderPassStage::overlay );
 		swapchainImageViews = CreateSwapchainImageViews ( device, swapchain, surfaceFormat.format );
-		CreateDepthBuffer ( physicalDevice, device, swapchainExtent, depthBuffer, depthBufferMemory, depthBufferView );
-		framebuffers = CreateFramebuffers ( device, renderPass, swapchainImageViews, depthBufferView, windowSize );
+		CreateDepthBuffer ( device, allocator, swapchainExtent, depthBuffer, depthBufferAllocation, depthBufferView );
+		framebuffers = CreateFramebuffers ( device, sceneRenderPass, swapchainImageViews, depthBufferView, windowSize );
 		graphicsCommandPool = device.createCommandPool ( { { vk::CommandPoolCreateFlagBits::eResetCommandBuffer }, queues.graphicsQueueFamilyIndex } );
-		transferCommandPool = device.createCommandPool ( { { vk::CommandPoolCreateFlagBits::eResetCommandBuffer }, queues.transferQueueFamilyIndex } );
-		renderCommandBuffer = device.allocateCommandBuffers ( { graphicsCommandPool, vk::CommandBufferLevel::ePrimary, 1 } ) [ 0 ];
-		imageAvailableSemaphore = device.createSemaphore ( {} );
-		renderFinishedSemaphore = device.createSemaphore ( {} );
-		renderFinishedFence = device.createFence ( { vk::FenceCreateFlagBits::eSignaled } );
+
+		frames.resize ( framesInFlight );
+
+		auto commandBuffers { device.allocateCommandBuffers ( { graphicsCommandPool, vk::CommandBufferLevel::ePrimary, framesInFlight } ) };
+
+		for ( int index { 0 }; auto & frame : frames )
+		{
+			frame.commandBuffer = commandBuffers [ index ];
+			++index;
+		}
+
+		CreateFrameSyncObjects ();
+
+		// A partition per frame, so recording uploads never waits for anything but the frame's own fence
+		stagingRing.Initialize ( { physicalDevice, device, allocator, &queues }, 4 * 1024 * 1024, framesInFlight );
 
 		camera.SetViewportSize ( windowSize );
 		camera.SetPosition ( { 0.0f, 0.0f, 1.0f } );
 
-		axel.Initialize ( { physicalDevice, device, &queues, renderPass } );
-		recterer.Initialize ( { physicalDevice, device, &queues, renderPass, transferCommandPool } );
-		texterer.Initialize ( { physicalDevice, device, &queues, renderPass, transferCommandPool } );
+		textureCache.Initialize ( { physicalDevice, device, allocator, &stagingRing } );
+
+		// Kept in the working directory
+		pipelineCache.Initialize ( { physicalDevice, device }, "PipelineCache.bin" );
+
+		axel.Initialize ( { physicalDevice, device, allocator, &queues, sceneRenderPass, &stagingRing, framesInFlight, &textureCache, &pipelineCache } );
+		axel.SetDepthBuffer ( depthBuffer, depthBufferView, swapchainExtent );
+		recterer.Initialize ( { physicalDevice, device, allocator, &queues, overlayRenderPass, &stagingRing, framesInFlight, &textureCache, &pipelineCache } );
+		texterer.Initialize ( { physicalDevice, device, allocator, &queues, overlayRenderPass, &stagingRing, framesInFlight, &pipelineCache } );
 
 		button1 = Button { recterer, texterer }
 			.SetText ( "Touch me ples\nplease" )
@@ -73,8 +92,21 @@ namespace pd
 
 		label1 = Label { recterer, texterer }.SetText ( "Jeff:Hello\nBob:Send pp\nEnd" ).SetPosition ( { 10, 10 } );
 
-		axel.LoadScene ( "scene/Plane.obj" );
+		// Drawn as it streams in, the first frame doesn't wait for it
+		axel.LoadSceneAsync ( "scene/Plane.obj" );
 		axel.SetCamera ( camera );
+
+		// Every subsystem queued its pipelines, they compiled while the rest was set up
+		auto pipelinesStart { std::chrono::steady_clock::now () };
+		pipelineCache.WaitForCompiles ();
+
+		auto startupEnd { std::chrono::steady_clock::now () };
+		auto milliseconds { [] ( auto duration ) { return std::chrono::duration_cast < std::chrono::milliseconds > ( duration ).count (); } };
+
+		std::cout << "Started in " << milliseconds ( startupEnd - startupStart ) << " ms, "
+			<< milliseconds ( startupEnd - pipelinesStart ) << " ms of it waiting for pipelines" << std::endl;
+
+		PrintMemoryReport ( allocator );
 	}
 
 	Application::~Application ()
@@ -84,28 +116,30 @@ namespace pd
 		axel.Shutdown ();
 		recterer.Shutdown ();
 		texterer.Shutdown ();
+		pipelineCache.Shutdown ();
+		textureCache.Shutdown ();
+		stagingRing.Shutdown ();
 
-		device.destroy ( renderFinishedFence );
-		device.destroy ( renderFinishedSemaphore );
-		device.destroy ( imageAvailableSemaphore );
+		DestroyFrameSyncObjects ();
 
-		device.freeCommandBuffers ( graphicsCommandPool, { renderCommandBuffer } );
+		for ( auto const & frame : frames )
+			device.freeCommandBuffers ( graphicsCommandPool, { frame.commandBuffer } );
 
 		device.destroy ( graphicsCommandPool );
-		device.destroy ( transferCommandPool );
 
 		for ( auto const & framebuffer : framebuffers )
 			device.destroy ( framebuffer );
 
 		device.destroy ( depthBufferView );
-		device.destroy ( depthBuffer );
-		device.free ( depthBufferMemory );
+		DestroyImage ( allocator, depthBuffer, depthBufferAllocation );
 
 		for ( auto const & imageView : swapchainImageViews )
 			device.destroy ( imageView );
 
-		device.destroy ( renderPass );
+		device.destroy ( sceneRenderPass );
+		device.destroy ( overlayRenderPass );
 		device.destroy ( swapchain );
+		vmaDestroyAllocator ( allocator );
 		device.destroy ();
 		instance.destroy ( surface );
 		instance.destroy ( debugUtilsMessenger );
@@ -186,6 +220,14 @@ namespace pd
 					case SDL_SCANCODE_S: cameraMoveDirection.z += -1.0f; break;
 					case SDL_SCANCODE_SPACE: cameraMoveDirection.y += 1.0f; break;
 					case SDL_SCANCODE_LSHIFT: cameraMoveDirection.y += -1.0f; break;
+					case SDL_SCANCODE_F3: PrintMemoryReport ( allocator ); break;
+					case SDL_SCANCODE_F4: axel.SetOcclusionCulling ( ! axel.GetOcclusionCulling () ); break;
+
+					// Cancels a scene load, what was streamed in so far goes with it
+					case SDL_SCANCODE_ESCAPE:
+						if ( axel.GetLoadProgress ().loading )
+							axel.UnloadScene ();
+						break;
 					}
 					break;
 				}
@@ -234,14 +276,43 @@ namespace pd
 		}
 
 		axel.SetCamera ( camera );
+
+		ShowLoadProgress ();
+	}
+
+	void Application::ShowLoadProgress ()
+	{
+		auto progress { axel.GetLoadProgress () };
+
+		if ( ! progress.loading && ! showingLoadProgress )
+			return;
+
+		showingLoadProgress = progress.loading;
+
+		std::string title { "Palladium" };
+
+		if ( progress.loading && progress.objectCount == 0 )
+			title += " - Reading scene";
+		else if ( progress.loading )
+		{
+			title += " - Loading " + std::to_string ( progress.residentObjectCount ) + "/" + std::to_string ( progress.objectCount ) + " meshes, "
+				+ std::to_string ( progress.residentTextureCount ) + "/" + std::to_string ( progress.textureCount ) + " textures";
+		}
+
+		SDL_SetWindowTitle ( window, title.c_str () );
 	}
 
 	void Application::Render ()
 	{
-		device.waitForFences ( { renderFinishedFence }, VK_FALSE, std::numeric_limits <uint64_t>::max () );
-		device.resetFences ( { renderFinishedFence } );
+		auto & frame { frames [ currentFrame ] };
 
-		auto acquireResult { device.acquireNextImageKHR ( swapchain, std::numeric_limits <uint64_t>::max (), imageAvailableSemaphore, {} ) };
+		// Only blocks once the GPU falls framesInFlight frames behind
+		device.waitForFences ( { frame.renderFinishedFence }, VK_FALSE, std::numeric_limits <uint64_t>::max () );
+
+		// Streams part of a scene being loaded and updates this frame's copies of what changed
+		axel.Update ( currentFrame );
+
+		auto acquireResult { device.acquireNextImageKHR ( swapchain, std::numeric_limits <uint64_t>::max (), frame.imageAvailableSemaphore, {} ) };
 
 		if ( acquireResult.result == vk::Result::eSuboptimalKHR || acquireResult.result == vk::Result::eErrorOutOfDateKHR )
 		{
@@ -249,37 +320,53 @@ namespace pd
 			return;
 		}
 
+		device.resetFences ( { frame.renderFinishedFence } );
 
 		auto imageIndex { acquireResult.value };
 
 		// Record
-		vk::CommandBufferInheritanceInfo inheritanceInfo { renderPass, 0, framebuffers [ imageIndex ] };
-		vk::CommandBufferBeginInfo beginInfo { {}, &inheritanceInfo };
+		vk::CommandBufferBeginInfo beginInfo {};
+
+		frame.commandBuffer.begin ( beginInfo );
 
-		renderCommandBuffer.begin ( beginInfo );
+		// Builds the frame's draws on the GPU, outside of any render pass
+		axel.RecordCulling ( frame.commandBuffer, currentFrame );
 
 		vk::Rect2D renderArea { { 0, 0 }, swapchainExtent };
 		std::vector <vk::ClearValue> clearValues { { { 0.0f, 0.0f, 0.0f, 1.0f } }, { { 1.0f } } };
-		vk::RenderPassBeginInfo renderPassBeginInfo { renderPass, framebuffers [ imageIndex ], renderArea, clearValues };
+		vk::RenderPassBeginInfo renderPassBeginInfo { sceneRenderPass, framebuffers [ imageIndex ], renderArea, clearValues };
 
-		renderCommandBuffer.beginRenderPass ( renderPassBeginInfo, vk::SubpassContents::eInline );
-		
-		axel.RecordRender ( renderCommandBuffer, swapchainExtent );
-		recterer.RecordRender ( renderCommandBuffer, swapchainExtent );
-		texterer.RecordRender ( renderCommandBuffer, swapchainExtent );
+		frame.commandBuffer.beginRenderPass ( renderPassBeginInfo, vk::SubpassContents::eInline );
+		axel.RecordRender ( frame.commandBuffer, swapchainExtent, currentFrame );
+		frame.commandBuffer.endRenderPass ();
+
+		// Reduced before the overlay draws, so its depth never occludes the scene in the next frame's culling
+		axel.RecordDepthPyramid ( frame.commandBuffer );
+
+		renderPassBeginInfo.renderPass = overlayRenderPass;
 
-		renderCommandBuffer.endRenderPass ();
+		frame.commandBuffer.beginRenderPass ( renderPassBeginInfo, vk::SubpassContents::eInline );
+		recterer.RecordRender ( frame.commandBuffer, swapchainExtent, currentFrame );
+		texterer.RecordRender ( frame.commandBuffer, swapchainExtent, currentFrame );
+		frame.commandBuffer.endRenderPass ();
 
-		renderCommandBuffer.end ();
+		frame.commandBuffer.end ();
 
-		Submit ( queues.graphicsQueue, { renderCommandBuffer }, renderFinishedFence, { renderFinishedSemaphore },
-			{ imageAvailableSemaphore }, { vk::PipelineStageFlagBits::eTopOfPipe } );
+		// Flush this frame's uploads, the render waits for them on the GPU instead of the CPU blocking
+		auto uploadsValue { stagingRing.Submit () };
 
-		auto presentResult { Present ( queues.presentationQueue, swapchain, imageIndex, renderFinishedSemaphore ) };
+		Submit ( queues.graphicsQueue, { frame.commandBuffer }, frame.renderFinishedFence, { renderFinishedSemaphores [ imageIndex ] },
+			{ frame.imageAvailableSemaphore, stagingRing.GetSemaphore () },
+			{ vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexInput
+				| vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader },
+			{}, { 0, uploadsValue } );
+
+		currentFrame = ( currentFrame + 1 ) % framesInFlight;
+
+		auto presentResult { Present ( queues.presentationQueue, swapchain, imageIndex, renderFinishedSemaphores [ imageIndex ] ) };
 
 		if ( presentResult == vk::Result::eSuboptimalKHR || presentResult == vk::Result::eErrorOutOfDateKHR )
 		{
-			device.waitIdle ();
 			UpdateSwapchain ();
 			return;
 		}
@@ -287,6 +374,8 @@ namespace pd
 
 	void Application::UpdateSwapchain ()
 	{
+		device.waitIdle ();
+
 		int windowWidth, windowHeight;
 		SDL_Vulkan_GetDrawableSize ( window, &windowWidth, &windowHeight );
 		std::cout << windowHeight << std::endl;
@@ -298,8 +387,10 @@ namespace pd
 		device.destroy ( oldSwapchain );
 		swapchainExtent = vk::Extent2D { static_cast < uint32_t > ( windowSize.x ), static_cast < uint32_t > ( windowSize.y ) };
 
-		device.destroy ( renderPass );
-		renderPass = CreateRenderPass ( device, surfaceFormat.format );
+		device.destroy ( sceneRenderPass );
+		device.destroy ( overlayRenderPass );
+		sceneRenderPass = CreateRenderPass ( device, surfaceFormat.format, RenderPassStage::scene );
+		overlayRenderPass = CreateRenderPass ( device, surfaceFormat.format, RenderPassStage::overlay );
 		
 		for ( auto const & imageView : swapchainImageViews )
 			device.destroy ( imageView );
@@ -309,24 +400,42 @@ namespace pd
 			device.destroy ( framebuffer );
 		
 		device.destroy ( depthBufferView );
-		device.destroy ( depthBuffer );
-		device.free ( depthBufferMemory );
+		DestroyImage ( allocator, depthBuffer, depthBufferAllocation );
 		
-		CreateDepthBuffer ( physicalDevice, device, swapchainExtent, depthBuffer, depthBufferMemory, depthBufferView );
+		CreateDepthBuffer ( device, allocator, swapchainExtent, depthBuffer, depthBufferAllocation, depthBufferView );
+		axel.SetDepthBuffer ( depthBuffer, depthBufferView, swapchainExtent );
 		
-		framebuffers = CreateFramebuffers ( device, renderPass, swapchainImageViews, depthBufferView, windowSize );
+		framebuffers = CreateFramebuffers ( device, sceneRenderPass, swapchainImageViews, depthBufferView, windowSize );
 		
-		device.free ( graphicsCommandPool, renderCommandBuffer );
-		renderCommandBuffer = device.allocateCommandBuffers ( { graphicsCommandPool, vk::CommandBufferLevel::ePrimary, 1 } ) [ 0 ];
+		// An acquire that failed may have left a semaphore signaled that nothing will wait on
+		DestroyFrameSyncObjects ();
+		CreateFrameSyncObjects ();
+	}
+
+	void Application::CreateFrameSyncObjects ()
+	{
+		for ( auto & frame : frames )
+		{
+			frame.imageAvailableSemaphore = device.createSemaphore ( {} );
+			frame.renderFinishedFence = device.createFence ( { vk::FenceCreateFlagBits::eSignaled } );
+		}
 
-		device.destroy ( imageAvailableSemaphore );
-		imageAvailableSemaphore = device.createSemaphore ( {} );
+		renderFinishedSemaphores.resize ( swapchainImageViews.size () );
 
-		device.destroy ( renderFinishedSemaphore );
-		renderFinishedSemaphore = device.createSemaphore ( {} );
+		for ( auto & semaphore : renderFinishedSemaphores )
+			semaphore = device.createSemaphore ( {} );
+	}
+
+	void Application::DestroyFrameSyncObjects ()
+	{
+		for ( auto const & frame : frames )
+		{
+			device.destroy ( frame.imageAvailableSemaphore );
+			device.destroy ( frame.renderFinishedFence );
+		}
 
-		device.destroy ( renderFinishedFence );
-		renderFinishedFence = device.createFence ( { vk::FenceCreateFlagBits::eSignaled } );
+		for ( auto const & semaphore : renderFinishedSemaphores )
+			device.destroy ( semaphore );
 	}
 
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Core.hpp"
+#include "StagingRing.hpp"
+#include "TextureCache.hpp"
+#include "PipelineCache.hpp"
 #include "Axel.hpp"
 #include "Recterer.hpp"
 #include "Texterer.hpp"
@@ -15,7 +18,7 @@ namespace pd
 	class Application
 	{
 	public:
-		Application ();
+		Application ( uint32_t framesInFlight = 2 );
 		~Application ();
 
 		void Run ();
@@ -23,11 +26,23 @@ namespace pd
 	private:
 		void HandleEvents ();
 		void Update ();
+		void ShowLoadProgress ();
 		void Render ();
 		void UpdateSwapchain ();
+		void CreateFrameSyncObjects ();
+		void DestroyFrameSyncObjects ();
+
+		// Resources the CPU records into while the GPU may still be drawing the previous frames
+		struct Frame
+		{
+			vk::CommandBuffer commandBuffer;
+			vk::Semaphore imageAvailableSemaphore;
+			vk::Fence renderFinishedFence;
+		};
 		
 		bool quit { false };
 		bool render { true };
+		bool showingLoadProgress { false };
 
 		SDL_Window * window;
 		vk::Instance instance;
@@ -40,18 +55,22 @@ namespace pd
 		vk::SurfaceFormatKHR surfaceFormat;
 		vk::SwapchainKHR swapchain;
 		vk::Extent2D swapchainExtent;
-		vk::RenderPass renderPass;
+		vk::RenderPass sceneRenderPass;
+		vk::RenderPass overlayRenderPass;
 		std::vector <vk::ImageView> swapchainImageViews;
 		vk::Image depthBuffer;
-		vk::DeviceMemory depthBufferMemory;
+		VmaAllocation depthBufferAllocation;
 		vk::ImageView depthBufferView;
 		std::vector <vk::Framebuffer> framebuffers;
 		vk::CommandPool graphicsCommandPool;
-		vk::CommandPool transferCommandPool;
-		vk::CommandBuffer renderCommandBuffer;
-		vk::Semaphore imageAvailableSemaphore;
-		vk::Semaphore renderFinishedSemaphore;
-		vk::Fence renderFinishedFence;
+		uint32_t framesInFlight;
+		std::vector <Frame> frames;
+		uint32_t currentFrame { 0 };
+		// One per swapchain image, presentation may still be waiting on it when the frame comes around again
+		std::vector <vk::Semaphore> renderFinishedSemaphores;
+		StagingRing stagingRing;
+		TextureCache textureCache;
+		PipelineCache pipelineCache;
 
 		Axel axel;
 		Recterer recterer;
@@ -1,6 +1,5 @@
 #include "Axel.hpp"
-
-#include "OBJ_Loader.h"
+#include "Shaders.hpp"
 
 namespace pd
 {
@@ -10,257 +9,831 @@ namespace pd
 
 		sampler = CreateDefaultSampler ( deps.device );
 
-		materialDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
-			{ 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eFragment },
+		sceneDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
+			{ 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+			{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment }
 		} );
 		
+		// Every texture of the scene, indexed per object
 		texturesDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
 			{ 0, vk::DescriptorType::eSampler, 1, vk::ShaderStageFlagBits::eFragment, &sampler },
-			{ 1, vk::DescriptorType::eSampledImage, 1, vk::ShaderStageFlagBits::eFragment },
-			{ 2, vk::DescriptorType::eSampledImage, 1, vk::ShaderStageFlagBits::eFragment },
-			{ 3, vk::DescriptorType::eSampledImage, 1, vk::ShaderStageFlagBits::eFragment }
-		} );
+			{ 1, vk::DescriptorType::eSampledImage, maxTextures, vk::ShaderStageFlagBits::eFragment }
+		}, { {}, vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eVariableDescriptorCount } );
 
-		cameraDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, { { 0, vk::DescriptorType::eUniformBuffer, 1,
+		cameraDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, { { 0, vk::DescriptorType::eUniformBufferDynamic, 1,
 			vk::ShaderStageFlagBits::eVertex } } );
 
-		pipelineLayout = CreatePipelineLayout ( deps.device, { cameraDSetLayout, materialDSetLayout, texturesDSetLayout } );
-		graphicsPipeline = CreateGraphicsPipeline ( { deps.device, deps.renderPass, 0, pipelineLayout } );
-		transferCommandPool = deps.device.createCommandPool ( { {}, deps.queues->transferQueueFamilyIndex } );
-		descriptorPool = CreateDescriptorPool ( deps.device );
+		pipelineLayout = CreatePipelineLayout ( deps.device, { cameraDSetLayout, sceneDSetLayout, texturesDSetLayout } );
+
+		// Compiled on worker threads while the rest initializes, the application waits for them before the first frame
+		deps.pipelineCache->Compile ( graphicsPipeline, [ this, deps ] () {
+			return CreateGraphicsPipeline ( { deps.device, deps.renderPass, 0, pipelineLayout, deps.pipelineCache->Get () } );
+		} );
+
+		// A texture table per frame in flight
+		descriptorPool = CreateDescriptorPool ( deps.device, maxTextures * deps.framesInFlight );
+
+		// CreateDevice enables these where they are supported
+		auto features { deps.physicalDevice.getFeatures () };
+		indirectDraws = features.multiDrawIndirect && features.drawIndirectFirstInstance;
+
+		compactDraws = deps.physicalDevice.getFeatures2 <vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features> ()
+			.get <vk::PhysicalDeviceVulkan12Features> ().drawIndirectCount;
+
+		maxDrawIndirectCount = deps.physicalDevice.getProperties ().limits.maxDrawIndirectCount;
 
 		{
-			CameraUniformBlock cameraData { glm::identity <glm::mat4> (), glm::identity <glm::mat4> () };
+			cameraData = { glm::identity <glm::mat4> (), glm::identity <glm::mat4> () };
+			cameraUniformBufferStride = GetUniformBufferStride ( deps.physicalDevice, sizeof ( CameraUniformBlock ) );
 
-			CreateBuffer ( deps.physicalDevice, deps.device, transferCommandPool, deps.queues->transferQueue,
-				BufferUsages::uniformBuffer, &cameraData, sizeof ( CameraUniformBlock ), cameraUniformBuffer, cameraUniformBufferMemory );
+			cameraUniformBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Axel", BufferUsages::uniformBuffer,
+				cameraUniformBufferStride * deps.framesInFlight, cameraUniformBuffer, cameraUniformBufferAllocation ) );
 
 			cameraDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, cameraDSetLayout );
 
 			vk::DescriptorBufferInfo bufferInfo { cameraUniformBuffer, 0, sizeof ( CameraUniformBlock ) };
-			vk::WriteDescriptorSet write { cameraDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &bufferInfo };
+			vk::WriteDescriptorSet write { cameraDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &bufferInfo };
 			deps.device.updateDescriptorSets ( { write }, {} );
 		}
+
+		// Culling and depth pyramid compute passes
+		{
+			depthSampler = CreateNearestSampler ( deps.device );
+
+			cullDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
+				{ 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eCompute },
+				{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+				{ 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+				{ 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute }
+			} );
+
+			depthPyramidDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
+				{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute, &depthSampler }
+			} );
+
+			cullPipelineLayout = CreatePipelineLayout ( deps.device, { cullDSetLayout, depthPyramidDSetLayout } );
+			deps.pipelineCache->Compile ( cullPipeline, [ this, deps ] () {
+				// Workgroup size, and whether visible draws are compacted
+				std::array <uint32_t, 2> constants { cullWorkgroupSize, compactDraws };
+				std::array <vk::SpecializationMapEntry, 2> entries { { { 0, 0, sizeof ( uint32_t ) }, { 1, sizeof ( uint32_t ), sizeof ( uint32_t ) } } };
+				vk::SpecializationInfo specialization { static_cast < uint32_t > ( entries.size () ), entries.data (), sizeof ( constants ), constants.data () };
+
+				return CreateComputePipeline ( deps.device, deps.pipelineCache->Get (), cullPipelineLayout, shader::cullShader, &specialization );
+			} );
+
+			depthReductionDSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
+				{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute, &depthSampler },
+				{ 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute }
+			} );
+
+			depthReductionPipelineLayout = CreatePipelineLayout ( deps.device, { depthReductionDSetLayout } );
+			deps.pipelineCache->Compile ( depthReductionPipeline, [ this, deps ] () {
+				// Square workgroups
+				std::array <uint32_t, 2> constants { depthReductionWorkgroupSize, depthReductionWorkgroupSize };
+				std::array <vk::SpecializationMapEntry, 2> entries { { { 0, 0, sizeof ( uint32_t ) }, { 1, sizeof ( uint32_t ), sizeof ( uint32_t ) } } };
+				vk::SpecializationInfo specialization { static_cast < uint32_t > ( entries.size () ), entries.data (), sizeof ( constants ), constants.data () };
+
+				return CreateComputePipeline ( deps.device, deps.pipelineCache->Get (), depthReductionPipelineLayout, shader::depthReductionShader,
+					&specialization );
+			} );
+
+			cullUniformBufferStride = GetUniformBufferStride ( deps.physicalDevice, sizeof ( CullUniformBlock ) );
+
+			cullUniformBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Axel", BufferUsages::uniformBuffer,
+				cullUniformBufferStride * deps.framesInFlight, cullUniformBuffer, cullUniformBufferAllocation ) );
+
+			depthPyramidDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, depthPyramidDSetLayout );
+		}
 	}
 
 	void Axel::Shutdown ()
 	{
 		UnloadScene ();
+		cancelledSceneLoaders.clear ();
 
-		deps.device.destroy ( cameraUniformBuffer );
-		deps.device.free ( cameraUniformBufferMemory );
+		DestroyDepthPyramid ();
 
-		deps.device.destroy ( materialUniformBuffer );
-		deps.device.free ( materialUniformBufferMemory );
+		DestroyBuffer ( deps.allocator, cameraUniformBuffer, cameraUniformBufferAllocation );
+		DestroyBuffer ( deps.allocator, cullUniformBuffer, cullUniformBufferAllocation );
+
+		// After the scene's sets, which UnloadScene frees once the frames using them are done
+		deps.stagingRing->DeferDestruction ( [ device = deps.device, descriptorPool = descriptorPool ] () {
+			device.destroy ( descriptorPool );
+		} );
 
-		deps.device.destroy ( descriptorPool );
-		deps.device.destroy ( transferCommandPool );
 		deps.device.destroy ( graphicsPipeline );
 		deps.device.destroy ( pipelineLayout );
+		deps.device.destroy ( cullPipeline );
+		deps.device.destroy ( cullPipelineLayout );
+		deps.device.destroy ( depthReductionPipeline );
+		deps.device.destroy ( depthReductionPipelineLayout );
+
+		deps.device.destroy ( cullDSetLayout );
+		deps.device.destroy ( depthPyramidDSetLayout );
+		deps.device.destroy ( depthReductionDSetLayout );
 		
 		deps.device.destroy ( cameraDSetLayout );
-		deps.device.destroy ( materialDSetLayout );
+		deps.device.destroy ( sceneDSetLayout );
 		deps.device.destroy ( texturesDSetLayout );
 		
 		deps.device.destroy ( sampler );
+		deps.device.destroy ( depthSampler );
 	}
 
-	void Axel::LoadScene ( std::filesystem::path const & path )
+	void Axel::LoadSceneAsync ( std::filesystem::path const & path )
 	{
 		assert ( std::filesystem::exists ( path ) );
 
-		if ( sceneLoaded )
-			UnloadScene ();
+		UnloadScene ();
 
-		sceneLoaded = true;
-		
-		objl::Loader loader;
-		loader.LoadFile ( path.generic_string () );
+		scenePath = path;
+		loadStart = std::chrono::steady_clock::now ();
+		sceneStream = std::make_shared <SceneStream> ();
 
-		std::vector <float> vertices;
-		std::vector <uint32_t> indices;
-		std::vector <MaterialUniformBlock> materials;
-		std::vector <std::filesystem::path> texturePaths { std::filesystem::current_path () / "image" / "White.png" };
+		// Already in upload layout, straight from the mapped cache when it is current
+		sceneLoader = std::jthread { [ stream = sceneStream, path ] () {
+			try
+			{
+				auto scene { LoadSceneData ( path ) };
 
-		struct ObjectTextureIndices
-		{
-			int ambient;
-			int diffuse;
-			int specular;
-		};
+				std::scoped_lock lock { stream->mutex };
+				stream->scene = std::move ( scene );
+			}
+			catch ( ... )
+			{
+				std::scoped_lock lock { stream->mutex };
+				stream->exception = std::current_exception ();
+			}
 
-		std::vector < ObjectTextureIndices> textureIndices;
-		
-		vertices.reserve ( loader.LoadedVertices.size () * ( 3 + 2 ) );
-		indices.reserve ( loader.LoadedIndices.size () );
-		materials.reserve ( loader.LoadedMaterials.size () );
-		texturePaths.reserve ( loader.LoadedMaterials.size () );
-		textureIndices.reserve ( loader.LoadedMeshes.size () );
+			stream->done = true;
+		} };
+	}
 
-		for ( auto const & mesh : loader.LoadedMeshes )
-		{
-			ObjectTextureIndices objectTextureIndices { 0, 0, 0 };
+	void Axel::BeginStreaming ( SceneData scene )
+	{
+		if ( scene.texturePaths.size () > maxTextures )
+			throw std::runtime_error { "Scene " + scenePath.generic_string () + " has more than " + std::to_string ( maxTextures ) + " textures" };
+
+		sceneLoaded = true;
 
-			ObjectInfo objectInfo {};
+		indexCount = static_cast < uint32_t > ( scene.indices.size () );
 
-			objectInfo.indexOffset = static_cast < int > ( indices.size () );
-			objectInfo.indexCount = static_cast < int > ( mesh.Indices.size () );
-			objectInfo.materialUniformBufferOffset = static_cast < uint32_t > ( materials.size () * sizeof ( MaterialUniformBlock ) );
+		// Filled by StreamGeometry
+		CreateBuffer ( deps.allocator, "Axel", BufferUsages::vertexBuffer, scene.vertices.size_bytes (), vertexBuffer, vertexBufferAllocation );
+		CreateBuffer ( deps.allocator, "Axel", BufferUsages::indexBuffer, scene.indices.size_bytes (), indexBuffer, indexBufferAllocation );
 
-			// Convert to indices into the global vertex buffer
-			for ( auto index : mesh.Indices )
-				indices.push_back ( vertices.size () / ( 3 + 2 ) + index );
+		// Textures some path already loaded, also for Recterer, show at once. Slot 0 is white and stands in for the rest until they are read
+		textures.assign ( scene.texturePaths.size (), std::nullopt );
+		std::vector < std::pair <uint32_t, std::filesystem::path> > textureReads;
 
-			// Load vertices as is
-			for ( auto const & vertex : mesh.Vertices )
-			{
-				vertices.push_back ( vertex.Position.X );
-				vertices.push_back ( vertex.Position.Y );
-				vertices.push_back ( vertex.Position.Z );
+		for ( uint32_t slot { 0 }; slot < textures.size (); ++slot )
+		{
+			if ( slot == 0 )
+				textures [ slot ] = deps.textureCache->Acquire ( scene.texturePaths [ slot ] );
+			else
+				textures [ slot ] = deps.textureCache->TryAcquire ( scene.texturePaths [ slot ] );
+
+			if ( textures [ slot ] )
+				++residentTextureCount;
+			else
+				textureReads.push_back ( { slot, scene.texturePaths [ slot ] } );
+		}
 
-				vertices.push_back ( vertex.TextureCoordinate.X );
-				vertices.push_back ( vertex.TextureCoordinate.Y );
-			}
+		// Every slot of every frame's table is written before the frame first binds it
+		for ( uint32_t frameIndex { 0 }; frameIndex < deps.framesInFlight; ++frameIndex )
+		{
+			texturesDescriptorSets.push_back ( AllocateDescriptorSet ( deps.device, descriptorPool, texturesDSetLayout,
+				static_cast < uint32_t > ( textures.size () ) ) );
+
+			pendingTextureSlots.emplace_back ( textures.size () );
+			std::iota ( pendingTextureSlots.back ().begin (), pendingTextureSlots.back ().end (), 0 );
+		}
 
-			glm::vec3 ambientColor { mesh.MeshMaterial.Ka.X, mesh.MeshMaterial.Ka.Y, mesh.MeshMaterial.Ka.Z };
-			glm::vec3 diffuseColor { mesh.MeshMaterial.Kd.X, mesh.MeshMaterial.Kd.Y, mesh.MeshMaterial.Kd.Z };
-			glm::vec3 specularColor { mesh.MeshMaterial.Ks.X, mesh.MeshMaterial.Ks.Y, mesh.MeshMaterial.Ks.Z };
+		stbi_set_flip_vertically_on_load ( 1 );
 
-			materials.push_back ( {
-				{ ambientColor == glm::zero <glm::vec3> () ? glm::one <glm::vec3> () : ambientColor, 1.0f },
-				{ diffuseColor == glm::zero <glm::vec3> () ? glm::one <glm::vec3> () : diffuseColor, 1.0f },
-				{ specularColor == glm::zero <glm::vec3> () ? glm::one <glm::vec3> () : specularColor, 1.0f },
-			});
+		// Replaces the scene file loader, which has delivered the scene and only has to return.
+		// Reading and decoding or transcoding dominate, textures become resident in the order they finish
+		sceneLoader = {};
+		sceneStream->done = false;
 
-			if ( ! mesh.MeshMaterial.map_Ka.empty () )
+		sceneLoader = std::jthread { [ stream = sceneStream, physicalDevice = deps.physicalDevice,
+			textureReads = std::move ( textureReads ) ] ( std::stop_token stopToken ) {
+			try
 			{
-				objectTextureIndices.ambient = texturePaths.size ();
-				texturePaths.push_back ( mesh.MeshMaterial.map_Ka );
+				ParallelFor ( textureReads.size (), [ & ] ( std::size_t index ) {
+					if ( stopToken.stop_requested () )
+						return;
+
+					auto const & [ slot, path ] { textureReads [ index ] };
+
+					// One missing or broken texture leaves its slot white, the rest of the scene still loads
+					try
+					{
+						auto file { LoadTextureFile ( physicalDevice, path ) };
+
+						std::scoped_lock lock { stream->mutex };
+						stream->textureFiles.push_back ( { slot, std::move ( file ) } );
+					}
+					catch ( std::exception const & exception )
+					{
+						std::cout << "Couldn't load texture " << path.generic_string () << ": " << exception.what () << std::endl;
+
+						std::scoped_lock lock { stream->mutex };
+						++stream->failedTextureCount;
+					}
+				} );
 			}
-
-			if ( ! mesh.MeshMaterial.map_Kd.empty () )
+			catch ( ... )
 			{
-				objectTextureIndices.diffuse = texturePaths.size ();
-				texturePaths.push_back ( mesh.MeshMaterial.map_Kd );
+				std::scoped_lock lock { stream->mutex };
+				stream->exception = std::current_exception ();
 			}
-		
-			textureIndices.push_back ( objectTextureIndices );
+
+			stream->done = true;
+		} };
+
+		// Sorted so objects sharing a material are drawn together, in index buffer order within those
+		// so that neighbouring meshes can merge into one draw
+		std::vector <uint32_t> objectOrder ( scene.objects.size () );
+		std::iota ( objectOrder.begin (), objectOrder.end (), 0 );
+
+		std::ranges::sort ( objectOrder, {}, [ & ] ( uint32_t objectIndex ) {
+			auto const & object { scene.objects [ objectIndex ] };
+			return std::tuple { object.material, object.lods [ 0 ].indexOffset };
+		} );
+
+		std::vector <ObjectShaderData> objectShaderData;
+		std::vector <CullObjectShaderData> cullObjectShaderData;
+
+		for ( auto objectIndex : objectOrder )
+		{
+			auto const & object { scene.objects [ objectIndex ] };
+
+			auto center { ( object.boundsMin + object.boundsMax ) * 0.5f };
+			auto extent { ( object.boundsMax - object.boundsMin ) * 0.5f };
+			auto radius { glm::length ( extent ) };
+
+			ObjectInfo objectInfo { {}, object.lodCount, object.material, center, radius };
+			std::ranges::copy ( object.lods, objectInfo.lods );
 			objectInfos.push_back ( objectInfo );
-		}
 
-		indexCount = loader.LoadedIndices.size ();
+			objectShaderData.push_back ( { object.material, { object.textures [ 0 ], object.textures [ 1 ], object.textures [ 2 ] } } );
+			objectBounds.Add ( object.boundsMin, object.boundsMax );
 
-		// Create vertex buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, transferCommandPool, deps.queues->transferQueue,
-			BufferUsages::vertexBuffer, vertices.data (), vertices.size () * sizeof ( float ), vertexBuffer, vertexBufferMemory );
+			CullObjectShaderData cullObject { center, radius, extent, object.lodCount, {} };
+			std::ranges::copy ( object.lods, cullObject.lods );
+			cullObjectShaderData.push_back ( cullObject );
+		}
 
-		// Create index buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, transferCommandPool, deps.queues->transferQueue,
-			BufferUsages::indexBuffer, indices.data (), indices.size () * sizeof ( uint32_t ), indexBuffer, indexBufferMemory );
+		// Storage buffers can't be empty
+		if ( objectShaderData.empty () )
+		{
+			objectShaderData.push_back ( {} );
+			cullObjectShaderData.push_back ( {} );
+		}
 
-		// Create material uniform buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, transferCommandPool, deps.queues->transferQueue,
-			BufferUsages::uniformBuffer, materials.data (), materials.size () * sizeof ( MaterialUniformBlock ), 
-			materialUniformBuffer, materialUniformBufferMemory);
+		// Create material and object storage buffers
+		CreateBuffer ( deps.allocator, "Axel", *deps.stagingRing,
+			BufferUsages::storageBuffer, scene.materials.data (), scene.materials.size_bytes (), 
+			materialBuffer, materialBufferAllocation );
 
-		// Create material descriptor set layout
-		materialDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, materialDSetLayout );
-		vk::DescriptorBufferInfo bufferInfo { materialUniformBuffer, 0, sizeof ( MaterialUniformBlock ) };
-		vk::WriteDescriptorSet write { materialDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &bufferInfo };
-		deps.device.updateDescriptorSets ( { write }, {} );
+		CreateBuffer ( deps.allocator, "Axel", *deps.stagingRing, BufferUsages::storageBuffer, objectShaderData.data (),
+			objectShaderData.size () * sizeof ( ObjectShaderData ), objectBuffer, objectBufferAllocation );
+
+		sceneDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, sceneDSetLayout );
 
-		for ( auto const & texturePath : texturePaths )
 		{
-			auto textureFilePath { 
-				texturePath.is_absolute () ? texturePath
-				: std::filesystem::absolute ( path.parent_path () ) / texturePath
-			};
+			vk::DescriptorBufferInfo materialBufferInfo { materialBuffer, 0, VK_WHOLE_SIZE };
+			vk::DescriptorBufferInfo objectBufferInfo { objectBuffer, 0, VK_WHOLE_SIZE };
 
-			assert ( std::filesystem::exists ( textureFilePath ) );
+			std::vector <vk::WriteDescriptorSet> writes {
+				{ sceneDescriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &materialBufferInfo },
+				{ sceneDescriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &objectBufferInfo }
+			};
 
-			Texture texture;
-			
-			CreateTexture ( deps.physicalDevice, deps.device, transferCommandPool,
-				deps.queues->transferQueue, deps.queues->transferQueueFamilyIndex,
-				textureFilePath.generic_string (), texture.texImage, texture.texImageView, texture.texMemory);
-			
-			textures.push_back ( texture );
+			deps.device.updateDescriptorSets ( writes, {} );
 		}
 
-		for ( int index { 0 }; auto const & objectTextureIndices : textureIndices )
+		// Every object visible is the most draws a frame can have
+		gpuCulling = indirectDraws && objectInfos.size () <= maxDrawIndirectCount;
+
+		if ( gpuCulling )
 		{
-			objectInfos [ index ].texturesDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, texturesDSetLayout );
+			CreateBuffer ( deps.allocator, "Axel", *deps.stagingRing, BufferUsages::storageBuffer, cullObjectShaderData.data (),
+				cullObjectShaderData.size () * sizeof ( CullObjectShaderData ), cullObjectBuffer, cullObjectBufferAllocation );
+
+			CreateBuffer ( deps.allocator, "Axel", BufferUsages::indirectBuffer,
+				cullObjectShaderData.size () * deps.framesInFlight * sizeof ( vk::DrawIndexedIndirectCommand ),
+				drawCommandBuffer, drawCommandBufferAllocation );
+
+			drawCounts = static_cast < uint32_t * > ( CreateMappedBuffer ( deps.allocator, "Axel", BufferUsages::indirectBuffer,
+				deps.framesInFlight * sizeof ( uint32_t ), drawCountBuffer, drawCountBufferAllocation ) );
+
+			std::fill_n ( drawCounts, deps.framesInFlight, 0u );
+			vmaFlushAllocation ( deps.allocator, drawCountBufferAllocation, 0, VK_WHOLE_SIZE );
+
+			cullDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, cullDSetLayout );
 
-			vk::DescriptorImageInfo ambientImageInfo { {}, textures [ objectTextureIndices.ambient ].texImageView, vk::ImageLayout::eShaderReadOnlyOptimal };
-			vk::DescriptorImageInfo diffuseImageInfo { {}, textures [ objectTextureIndices.diffuse ].texImageView, vk::ImageLayout::eShaderReadOnlyOptimal };
-			vk::DescriptorImageInfo specularImageInfo { {}, textures [ objectTextureIndices.specular ].texImageView, vk::ImageLayout::eShaderReadOnlyOptimal };
+			vk::DescriptorBufferInfo uniformBufferInfo { cullUniformBuffer, 0, sizeof ( CullUniformBlock ) };
+			vk::DescriptorBufferInfo objectBufferInfo { cullObjectBuffer, 0, VK_WHOLE_SIZE };
+			vk::DescriptorBufferInfo commandBufferInfo { drawCommandBuffer, 0, VK_WHOLE_SIZE };
+			vk::DescriptorBufferInfo countBufferInfo { drawCountBuffer, 0, VK_WHOLE_SIZE };
 
 			std::vector <vk::WriteDescriptorSet> writes {
-				{ objectInfos [ index ].texturesDescriptorSet, 1, 0, 1, vk::DescriptorType::eSampledImage, & ambientImageInfo },
-				{ objectInfos [ index ].texturesDescriptorSet, 2, 0, 1, vk::DescriptorType::eSampledImage, & diffuseImageInfo },
-				{ objectInfos [ index ].texturesDescriptorSet, 3, 0, 1, vk::DescriptorType::eSampledImage, & specularImageInfo },
+				{ cullDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &uniformBufferInfo },
+				{ cullDescriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &objectBufferInfo },
+				{ cullDescriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &commandBufferInfo },
+				{ cullDescriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &countBufferInfo }
 			};
 
 			deps.device.updateDescriptorSets ( writes, {} );
-
-			++index;
 		}
 
+		streamingScene = std::move ( scene );
 	}
 
 	void Axel::UnloadScene ()
 	{
+		// Cancels a load in progress, its loader finishes the file it is reading on its own
+		if ( sceneStream )
+		{
+			sceneLoader.request_stop ();
+			cancelledSceneLoaders.push_back ( { std::move ( sceneLoader ), sceneStream } );
+			sceneStream.reset ();
+			streamingScene.reset ();
+		}
+
+		if ( ! sceneLoaded )
+			return;
+
 		sceneLoaded = false;
 
-		deps.device.destroy ( vertexBuffer );
-		deps.device.free ( vertexBufferMemory );
-		deps.device.destroy ( indexBuffer );
-		deps.device.free ( indexBufferMemory );
+		// Frames in flight may still bind the scene's descriptor sets
+		std::vector <vk::DescriptorSet> descriptorSets { texturesDescriptorSets };
+		descriptorSets.push_back ( sceneDescriptorSet );
+
+		if ( gpuCulling )
+			descriptorSets.push_back ( cullDescriptorSet );
+
+		deps.stagingRing->DeferDestruction ( [ device = deps.device, allocator = deps.allocator,
+			descriptorPool = descriptorPool, descriptorSets = std::move ( descriptorSets ),
+			vertexBuffer = vertexBuffer, vertexBufferAllocation = vertexBufferAllocation,
+			indexBuffer = indexBuffer, indexBufferAllocation = indexBufferAllocation,
+			materialBuffer = materialBuffer, materialBufferAllocation = materialBufferAllocation,
+			objectBuffer = objectBuffer, objectBufferAllocation = objectBufferAllocation,
+			cullObjectBuffer = cullObjectBuffer, cullObjectBufferAllocation = cullObjectBufferAllocation,
+			drawCommandBuffer = drawCommandBuffer, drawCommandBufferAllocation = drawCommandBufferAllocation,
+			drawCountBuffer = drawCountBuffer, drawCountBufferAllocation = drawCountBufferAllocation ] () {
+			DestroyBuffer ( allocator, vertexBuffer, vertexBufferAllocation );
+			DestroyBuffer ( allocator, indexBuffer, indexBufferAllocation );
+			DestroyBuffer ( allocator, materialBuffer, materialBufferAllocation );
+			DestroyBuffer ( allocator, objectBuffer, objectBufferAllocation );
+			DestroyBuffer ( allocator, cullObjectBuffer, cullObjectBufferAllocation );
+			DestroyBuffer ( allocator, drawCommandBuffer, drawCommandBufferAllocation );
+			DestroyBuffer ( allocator, drawCountBuffer, drawCountBufferAllocation );
+
+			device.free ( descriptorPool, descriptorSets );
+		} );
+
+		// The next scene may be culled on the CPU and not replace these
+		cullObjectBufferAllocation = {};
+		drawCommandBufferAllocation = {};
+		drawCountBufferAllocation = {};
 
 		for ( auto const & texture : textures )
 		{
-			deps.device.destroy ( texture.texImageView );
-			deps.device.destroy ( texture.texImage );
-			deps.device.free ( texture.texMemory );
+			if ( texture )
+				deps.textureCache->Release ( *texture );
+		}
+
+		texturesDescriptorSets.clear ();
+		pendingTextureSlots.clear ();
+		textures.clear ();
+		objectInfos.clear ();
+		objectBounds.Clear ();
+		visibleObjects.clear ();
+		visibleObjectCount = 0;
+
+		residentVertexBytes = 0;
+		residentObjectCount = 0;
+		residentTextureCount = 0;
+		failedTextureCount = 0;
+	}
+
+	Axel::LoadProgress Axel::GetLoadProgress () const
+	{
+		return { sceneStream != nullptr, residentObjectCount, static_cast < uint32_t > ( objectInfos.size () ),
+			residentTextureCount, static_cast < uint32_t > ( textures.size () ) };
+	}
+
+	void Axel::Update ( uint32_t frameIndex )
+	{
+		std::erase_if ( cancelledSceneLoaders, [] ( CancelledSceneLoader const & loader ) { return loader.stream->done.load (); } );
+
+		if ( sceneStream )
+		{
+			std::exception_ptr exception;
+			std::optional <SceneData> scene;
+
+			{
+				std::scoped_lock lock { sceneStream->mutex };
+				exception = sceneStream->exception;
+				scene = std::exchange ( sceneStream->scene, std::nullopt );
+			}
+
+			if ( exception )
+			{
+				UnloadScene ();
+
+				try
+				{
+					std::rethrow_exception ( exception );
+				}
+				catch ( std::exception const & error )
+				{
+					std::cout << "Couldn't load scene " << scenePath.generic_string () << ": " << error.what () << std::endl;
+				}
+
+				return;
+			}
+
+			if ( scene )
+				BeginStreaming ( std::move ( *scene ) );
+
+			if ( sceneLoaded )
+			{
+				StreamGeometry ();
+				StreamTextures ();
+			}
+
+			if ( sceneLoaded && residentObjectCount == objectInfos.size () && residentTextureCount + failedTextureCount == textures.size () )
+			{
+				auto loadTime { std::chrono::duration_cast < std::chrono::milliseconds > ( std::chrono::steady_clock::now () - loadStart ) };
+
+				std::cout << "Loaded " << scenePath.generic_string () << " in " << loadTime.count () << " ms: "
+					<< streamingScene->vertices.size () / SceneData::vertexComponents << " vertices, "
+					<< streamingScene->indices.size () / 3 << " triangles, " << objectInfos.size () << " meshes" << std::endl;
+
+				// Every file it read has been taken, it is done
+				sceneLoader = {};
+				sceneStream.reset ();
+				streamingScene.reset ();
+			}
 		}
 
-		for ( auto const & objectInfo : objectInfos )
+		if ( ! sceneLoaded )
+			return;
+
+		// The frame's fence was waited on, no command buffer still uses its table
+		auto & slots { pendingTextureSlots [ frameIndex ] };
+
+		if ( slots.empty () )
+			return;
+
+		std::vector <vk::DescriptorImageInfo> imageInfos;
+		imageInfos.reserve ( slots.size () );
+
+		std::vector <vk::WriteDescriptorSet> writes;
+
+		for ( auto slot : slots )
 		{
-			deps.device.free ( descriptorPool, objectInfo.texturesDescriptorSet );
+			auto texture { textures [ slot ].value_or ( *textures [ 0 ] ) };
+			imageInfos.push_back ( { {}, deps.textureCache->GetView ( texture ), vk::ImageLayout::eShaderReadOnlyOptimal } );
+			writes.push_back ( { texturesDescriptorSets [ frameIndex ], 1, slot, 1, vk::DescriptorType::eSampledImage, &imageInfos.back () } );
+		}
+
+		deps.device.updateDescriptorSets ( writes, {} );
+		slots.clear ();
+	}
+
+	void Axel::StreamGeometry ()
+	{
+		auto const & scene { *streamingScene };
+		vk::DeviceSize uploaded { 0 };
+
+		// Every vertex first, objects index anywhere into them
+		if ( residentVertexBytes < scene.vertices.size_bytes () )
+		{
+			uploaded = std::min ( streamBudget, scene.vertices.size_bytes () - residentVertexBytes );
+
+			deps.stagingRing->UpdateBuffer ( vertexBuffer, reinterpret_cast < std::byte const * > ( scene.vertices.data () ) + residentVertexBytes,
+				uploaded, residentVertexBytes );
+
+			residentVertexBytes += uploaded;
+		}
+
+		// Then objects in draw order, each one drawable as soon as all its levels are uploaded. The frame waits for
+		// the staging ring's submission, so what is recorded now can be drawn this frame
+		while ( residentVertexBytes == scene.vertices.size_bytes () && residentObjectCount < objectInfos.size () && uploaded < streamBudget )
+		{
+			auto const & objectInfo { objectInfos [ residentObjectCount ] };
+
+			for ( uint32_t level { 0 }; level < objectInfo.lodCount; ++level )
+			{
+				auto const & lod { objectInfo.lods [ level ] };
+				auto size { lod.indexCount * sizeof ( uint32_t ) };
+
+				if ( size > 0 )
+					deps.stagingRing->UpdateBuffer ( indexBuffer, scene.indices.data () + lod.indexOffset, size, lod.indexOffset * sizeof ( uint32_t ) );
+
+				uploaded += size;
+			}
+
+			++residentObjectCount;
+		}
+	}
+
+	void Axel::StreamTextures ()
+	{
+		std::vector < std::pair <uint32_t, TextureFile> > textureFiles;
+
+		{
+			std::scoped_lock lock { sceneStream->mutex };
+
+			auto & readFiles { sceneStream->textureFiles };
+			auto takenFiles { readFiles.begin () };
+
+			// Roughly, block compressed files are smaller
+			for ( vk::DeviceSize size { 0 }; takenFiles != readFiles.end () && size < streamBudget; ++takenFiles )
+				size += vk::DeviceSize { takenFiles->second.extent.width } * takenFiles->second.extent.height * 4;
+
+			textureFiles.assign ( std::make_move_iterator ( readFiles.begin () ), std::make_move_iterator ( takenFiles ) );
+			readFiles.erase ( readFiles.begin (), takenFiles );
+
+			failedTextureCount += std::exchange ( sceneStream->failedTextureCount, 0 );
+		}
+
+		for ( auto const & [ slot, file ] : textureFiles )
+		{
+			textures [ slot ] = deps.textureCache->Acquire ( streamingScene->texturePaths [ slot ], file );
+			++residentTextureCount;
+
+			for ( auto & slots : pendingTextureSlots )
+				slots.push_back ( slot );
 		}
 	}
 	
 	void Axel::SetCamera ( Camera const & camera )
 	{
-		CameraUniformBlock cameraData { camera.GetViewMatrix (), camera.GetProjectionMatrix () };
-		
-		UpdateBuffer ( deps.physicalDevice, deps.device, transferCommandPool, deps.queues->transferQueue, 
-			cameraUniformBuffer, &cameraData, sizeof ( CameraUniformBlock ) );
-		
-		vk::DescriptorBufferInfo bufferInfo { cameraUniformBuffer, 0, sizeof ( CameraUniformBlock ) };
-		vk::WriteDescriptorSet write { cameraDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &bufferInfo };
+		cameraData = { camera.GetViewMatrix (), camera.GetProjectionMatrix () };
+		cameraPosition = camera.GetPosition ();
+	}
+
+	void Axel::SetDepthBuffer ( vk::Image image, vk::ImageView view, vk::Extent2D extent )
+	{
+		DestroyDepthPyramid ();
+
+		depthBuffer = image;
+		depthBufferExtent = extent;
+		depthPyramidValid = false;
+
+		CreateDepthPyramid ( deps.device, deps.allocator, "Axel", extent, depthPyramid, depthPyramidAllocation,
+			depthPyramidView, depthPyramidLevelViews );
+
+		for ( std::size_t level { 0 }; level < depthPyramidLevelViews.size (); ++level )
+		{
+			auto descriptorSet { AllocateDescriptorSet ( deps.device, descriptorPool, depthReductionDSetLayout ) };
+
+			// Level 0 is a copy of the depth buffer
+			vk::DescriptorImageInfo sourceInfo { {}, level == 0 ? view : depthPyramidLevelViews [ level - 1 ],
+				level == 0 ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eGeneral };
+			vk::DescriptorImageInfo destinationInfo { {}, depthPyramidLevelViews [ level ], vk::ImageLayout::eGeneral };
+
+			std::vector <vk::WriteDescriptorSet> writes {
+				{ descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &sourceInfo },
+				{ descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageImage, &destinationInfo }
+			};
+
+			deps.device.updateDescriptorSets ( writes, {} );
+			depthReductionDescriptorSets.push_back ( descriptorSet );
+		}
+
+		vk::DescriptorImageInfo pyramidInfo { {}, depthPyramidView, vk::ImageLayout::eGeneral };
+		vk::WriteDescriptorSet write { depthPyramidDescriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &pyramidInfo };
 		deps.device.updateDescriptorSets ( { write }, {} );
 	}
 
-	void Axel::RecordRender ( vk::CommandBuffer renderCommandBuffer, vk::Extent2D const & viewportExtent )
+	void Axel::DestroyDepthPyramid ()
+	{
+		if ( ! depthPyramidAllocation )
+			return;
+
+		deps.device.free ( descriptorPool, depthReductionDescriptorSets );
+		depthReductionDescriptorSets.clear ();
+
+		for ( auto const & levelView : depthPyramidLevelViews )
+			deps.device.destroy ( levelView );
+
+		depthPyramidLevelViews.clear ();
+
+		deps.device.destroy ( depthPyramidView );
+		DestroyImage ( deps.allocator, depthPyramid, depthPyramidAllocation );
+		depthPyramidAllocation = {};
+	}
+
+	void Axel::SetOcclusionCulling ( bool enabled )
+	{
+		occlusionCulling = enabled;
+
+		// Not kept up to date while disabled
+		if ( ! enabled )
+			depthPyramidValid = false;
+	}
+
+	void Axel::RecordCulling ( vk::CommandBuffer commandBuffer, uint32_t frameIndex )
+	{
+		if ( ! sceneLoaded || ! gpuCulling ) return;
+
+		// The caller waited for this frame's fence, so its count is the one culled framesInFlight frames ago
+		vmaInvalidateAllocation ( deps.allocator, drawCountBufferAllocation, frameIndex * sizeof ( uint32_t ), sizeof ( uint32_t ) );
+		visibleObjectCount = drawCounts [ frameIndex ];
+
+		auto objectCount { static_cast < uint32_t > ( objectInfos.size () ) };
+
+		CullUniformBlock cullData {
+			GetFrustum ( cameraData.projectionMatrix * cameraData.viewMatrix ),
+			cameraPosition,
+			cameraData.projectionMatrix [ 1 ] [ 1 ],
+			depthPyramidViewProjection,
+			{ static_cast < float > ( depthBufferExtent.width ), static_cast < float > ( depthBufferExtent.height ) },
+			residentObjectCount,
+			objectCount * frameIndex,
+			frameIndex,
+			occlusionCulling && depthPyramidValid,
+			lodScreenSize
+		};
+
+		auto cullOffset { cullUniformBufferStride * frameIndex };
+		std::memcpy ( cullUniformBufferData + cullOffset, &cullData, sizeof ( CullUniformBlock ) );
+		vmaFlushAllocation ( deps.allocator, cullUniformBufferAllocation, cullOffset, sizeof ( CullUniformBlock ) );
+
+		commandBuffer.fillBuffer ( drawCountBuffer, frameIndex * sizeof ( uint32_t ), sizeof ( uint32_t ), 0 );
+
+		{
+			vk::MemoryBarrier clearBarrier { vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+			std::vector <vk::ImageMemoryBarrier> imageBarriers;
+
+			// Bound though unread until a pyramid is built, it still has to be in the layout it is bound with
+			if ( ! depthPyramidValid )
+			{
+				imageBarriers.push_back ( { vk::AccessFlagBits::eNone, vk::AccessFlagBits::eShaderRead,
+					vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+					depthPyramid, { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1 } } );
+			}
+
+			commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {},
+				{ clearBarrier }, {}, imageBarriers );
+		}
+
+		commandBuffer.bindPipeline ( vk::PipelineBindPoint::eCompute, cullPipeline );
+		commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, { cullDescriptorSet, depthPyramidDescriptorSet },
+			{ static_cast < uint32_t > ( cullOffset ) } );
+		commandBuffer.dispatch ( ( residentObjectCount + cullWorkgroupSize - 1 ) / cullWorkgroupSize, 1, 1 );
+
+		// Read as draws, and by the host once the frame's fence is signaled
+		vk::MemoryBarrier cullBarrier { vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eHostRead };
+		commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eHost, {},
+			{ cullBarrier }, {}, {} );
+	}
+
+	void Axel::RecordRender ( vk::CommandBuffer renderCommandBuffer, vk::Extent2D const & viewportExtent, uint32_t frameIndex )
 	{
 		if ( ! sceneLoaded ) return;
 
+		// The GPU is done with this frame's copy, the caller waited for its fence
+		auto cameraOffset { cameraUniformBufferStride * frameIndex };
+		std::memcpy ( cameraUniformBufferData + cameraOffset, &cameraData, sizeof ( CameraUniformBlock ) );
+		vmaFlushAllocation ( deps.allocator, cameraUniformBufferAllocation, cameraOffset, sizeof ( CameraUniformBlock ) );
+
 		renderCommandBuffer.bindPipeline ( vk::PipelineBindPoint::eGraphics, graphicsPipeline );
 		
 		SetViewport ( renderCommandBuffer, viewportExtent );
 
-		renderCommandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { cameraDescriptorSet }, {} );
+		renderCommandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { cameraDescriptorSet },
+			{ static_cast < uint32_t > ( cameraOffset ) } );
 		renderCommandBuffer.bindVertexBuffers ( 0, { vertexBuffer }, { 0 } );
 		renderCommandBuffer.bindIndexBuffer ( indexBuffer, 0, vk::IndexType::eUint32 );
-		 
-		for ( auto const & objectInfo : objectInfos )
+
+		// Every texture and material is reachable from every draw
+		renderCommandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, { sceneDescriptorSet, texturesDescriptorSets [ frameIndex ] }, {} );
+
+		if ( gpuCulling )
 		{
-			renderCommandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 1,
-				{ materialDescriptorSet, objectInfo.texturesDescriptorSet }, { objectInfo.materialUniformBufferOffset } );
-			
-			renderCommandBuffer.drawIndexed ( objectInfo.indexCount, 1, objectInfo.indexOffset, 0, 0);
+			auto objectCount { static_cast < uint32_t > ( objectInfos.size () ) };
+			auto commandOffset { static_cast < vk::DeviceSize > ( objectCount ) * frameIndex * sizeof ( vk::DrawIndexedIndirectCommand ) };
+
+			// Whatever the culling shader kept is one draw, the CPU never touches the objects
+			if ( compactDraws )
+			{
+				renderCommandBuffer.drawIndexedIndirectCount ( drawCommandBuffer, commandOffset, drawCountBuffer, frameIndex * sizeof ( uint32_t ),
+					residentObjectCount, sizeof ( vk::DrawIndexedIndirectCommand ) );
+			}
+			else
+				renderCommandBuffer.drawIndexedIndirect ( drawCommandBuffer, commandOffset, residentObjectCount, sizeof ( vk::DrawIndexedIndirectCommand ) );
+
+			return;
 		}
 
+		visibleObjects.clear ();
+		objectBounds.Cull ( GetFrustum ( cameraData.projectionMatrix * cameraData.viewMatrix ), visibleObjects );
+
+		// Objects still streaming in have no indices yet
+		std::erase_if ( visibleObjects, [ this ] ( uint32_t objectIndex ) { return objectIndex >= residentObjectCount; } );
+		visibleObjectCount = static_cast < uint32_t > ( visibleObjects.size () );
+
+		// Visible objects stay sorted, neighbouring meshes with the same material merge into one draw
+		drawCommands.clear ();
+
+		for ( auto objectIndex : visibleObjects )
+		{
+			auto const & objectInfo { objectInfos [ objectIndex ] };
+			auto const & lod { objectInfo.lods [ SelectLod ( objectInfo ) ] };
+
+			if ( ! drawCommands.empty () )
+			{
+				auto & previousCommand { drawCommands.back () };
+
+				if ( objectInfos [ previousCommand.firstInstance ].material == objectInfo.material
+					&& previousCommand.firstIndex + previousCommand.indexCount == lod.indexOffset )
+				{
+					previousCommand.indexCount += lod.indexCount;
+					continue;
+				}
+			}
+
+			drawCommands.push_back ( { lod.indexCount, 1, lod.indexOffset, 0, objectIndex } );
+		}
+
+		for ( auto const & command : drawCommands )
+			renderCommandBuffer.drawIndexed ( command.indexCount, 1, command.firstIndex, 0, command.firstInstance );
+	}
+
+	// The same choice as the culling shader makes
+	uint32_t Axel::SelectLod ( ObjectInfo const & objectInfo ) const
+	{
+		auto distance { glm::distance ( cameraPosition, objectInfo.center ) };
+
+		if ( distance <= objectInfo.radius )
+			return 0;
+
+		auto screenSize { objectInfo.radius * cameraData.projectionMatrix [ 1 ] [ 1 ] / distance };
+
+		if ( screenSize >= lodScreenSize )
+			return 0;
+
+		// Each level serves half the projected size of the one before
+		auto lod { 1.0f + std::floor ( std::log2 ( lodScreenSize / screenSize ) ) };
+		return static_cast < uint32_t > ( std::min ( lod, static_cast < float > ( objectInfo.lodCount - 1 ) ) );
+	}
+
+	void Axel::RecordDepthPyramid ( vk::CommandBuffer commandBuffer )
+	{
+		if ( ! sceneLoaded || ! gpuCulling || ! occlusionCulling ) return;
+
+		vk::ImageSubresourceRange depthRange { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+		vk::ImageSubresourceRange pyramidRange { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+		// The previous pyramid was read by this frame's culling, every level is rewritten
+		{
+			std::vector <vk::ImageMemoryBarrier> barriers {
+				{ vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::AccessFlagBits::eShaderRead,
+					vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+					VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, depthBuffer, depthRange },
+				{ vk::AccessFlagBits::eNone, vk::AccessFlagBits::eShaderWrite,
+					vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+					VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, depthPyramid, pyramidRange }
+			};
+
+			commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests
+				| vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, barriers );
+		}
+
+		commandBuffer.bindPipeline ( vk::PipelineBindPoint::eCompute, depthReductionPipeline );
+
+		for ( std::size_t level { 0 }; level < depthPyramidLevelViews.size (); ++level )
+		{
+			auto extent { GetMipLevelExtent ( depthBufferExtent, static_cast < uint32_t > ( level ) ) };
+
+			commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eCompute, depthReductionPipelineLayout, 0, { depthReductionDescriptorSets [ level ] }, {} );
+			commandBuffer.dispatch ( ( extent.width + depthReductionWorkgroupSize - 1 ) / depthReductionWorkgroupSize,
+				( extent.height + depthReductionWorkgroupSize - 1 ) / depthReductionWorkgroupSize, 1 );
+
+			// Each level reads the one before it, the next frame's culling reads them all
+			vk::MemoryBarrier levelBarrier { vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+			commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {},
+				{ levelBarrier }, {}, {} );
+		}
+
+		// Back to an attachment for the overlay and the next frame's scene pass
+		vk::ImageMemoryBarrier depthBarrier { vk::AccessFlagBits::eNone,
+			vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, depthBuffer, depthRange };
+
+		commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests, {}, {}, {}, { depthBarrier } );
+
+		depthPyramidViewProjection = cameraData.projectionMatrix * cameraData.viewMatrix;
+		depthPyramidValid = true;
 	}
-}
+}
\ No newline at end of file
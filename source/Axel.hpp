@@ -1,7 +1,12 @@
 #pragma once
 
 #include "Core.hpp"
+#include "StagingRing.hpp"
+#include "TextureCache.hpp"
+#include "PipelineCache.hpp"
+#include "SceneCache.hpp"
 #include "Camera.hpp"
+#include "Frustum.hpp"
 
 /*
 	A simple static scene renderer
@@ -16,80 +21,302 @@ namespace pd
 		{
 			vk::PhysicalDevice physicalDevice;
 			vk::Device device;
+			VmaAllocator allocator;
 			DeviceQueues const * queues;
 			vk::RenderPass renderPass;
+			StagingRing * stagingRing;
+			uint32_t framesInFlight;
+			TextureCache * textureCache;
+			PipelineCache * pipelineCache;
 		};
 
 		void Initialize ( Dependencies const & );
 		void Shutdown ();
 
-		void LoadScene ( std::filesystem::path const & sceneFilePath );
+		// Returns at once. The scene is read and its textures decoded on loader threads, Update streams them to the GPU
+		// and objects are drawn as they become resident, with a white texture until their own ones are
+		void LoadSceneAsync ( std::filesystem::path const & sceneFilePath );
+
+		// Cancels a load in progress too
 		void UnloadScene ();
 
+		// Counts stay zero until the scene file is read
+		struct LoadProgress
+		{
+			bool loading;
+			uint32_t residentObjectCount;
+			uint32_t objectCount;
+			uint32_t residentTextureCount;
+			uint32_t textureCount;
+		};
+
+		LoadProgress GetLoadProgress () const;
+
+		// Once per frame, after its fence is waited on and before anything is recorded. Takes what the loader threads
+		// finished and uploads part of it, and points the frame's texture table at the textures that arrived since
+		void Update ( uint32_t frameIndex );
+
 		void SetCamera ( Camera const & );
 
-		void RecordRender ( vk::CommandBuffer, vk::Extent2D const & viewportExtent );
+		// The depth buffer the scene is drawn into, the GPU must be done with the previous one
+		void SetDepthBuffer ( vk::Image, vk::ImageView, vk::Extent2D );
+
+		// Skips objects hidden behind the depth of the previous frame, where culling runs on the GPU
+		void SetOcclusionCulling ( bool );
+		bool GetOcclusionCulling () const;
+
+		// Outside of a render pass, before RecordRender
+		void RecordCulling ( vk::CommandBuffer, uint32_t frameIndex );
+
+		void RecordRender ( vk::CommandBuffer, vk::Extent2D const & viewportExtent, uint32_t frameIndex );
+
+		// Outside of a render pass, after the scene is drawn and before anything else draws into its depth
+		void RecordDepthPyramid ( vk::CommandBuffer );
+
+		// Objects drawn and culled in the last recorded frame, or framesInFlight frames before it when culled on the GPU
+		uint32_t GetVisibleObjectCount () const;
+		uint32_t GetCulledObjectCount () const;
 
 	private:
+		void DestroyDepthPyramid ();
+		void BeginStreaming ( SceneData );
+		void StreamGeometry ();
+		void StreamTextures ();
+
 		struct CameraUniformBlock
 		{
 			glm::mat4 viewMatrix;
 			glm::mat4 projectionMatrix;
 		};
 
-		struct MaterialUniformBlock
+		using MaterialShaderData = SceneData::Material;
+
+		// Filled by the loader threads, taken by Update
+		struct SceneStream
 		{
-			glm::vec4 ambientColor { 1.0f, 1.0f, 1.0f, 1.0f };
-			glm::vec4 diffuseColor { 1.0f, 1.0f, 1.0f, 1.0f };
-			glm::vec4 specularColor { 1.0f, 1.0f, 1.0f, 1.0f };
+			std::mutex mutex;
+			std::optional <SceneData> scene;
+
+			// Slots in the scene's texture table and their files, in the order they were read
+			std::vector < std::pair <uint32_t, TextureFile> > textureFiles;
+
+			// Textures that couldn't be read, their slots keep showing white
+			uint32_t failedTextureCount { 0 };
+
+			// The scene file couldn't be read, the scene is dropped
+			std::exception_ptr exception;
+
+			// Set by a loader as it returns
+			std::atomic <bool> done { false };
+		};
+
+		struct CancelledSceneLoader
+		{
+			std::jthread thread;
+			std::shared_ptr <SceneStream> stream;
+		};
+
+		// Indexed with gl_InstanceIndex, which every draw sets to its object's index through its first instance
+		struct ObjectShaderData
+		{
+			uint32_t material;
+
+			// Ambient, diffuse and specular, indices into the scene's texture table
+			uint32_t textures [ 3 ];
 		};
 
+		// Sorted by material, so neighbouring meshes sharing one can merge into a single draw
 		struct ObjectInfo
 		{
-			int indexOffset;
-			int indexCount;	
-			
-			uint32_t materialUniformBufferOffset;
-			vk::DescriptorSet texturesDescriptorSet;
+			SceneData::Lod lods [ SceneData::maxLods ];
+			uint32_t lodCount;
+			uint32_t material;
+
+			// World space bounding sphere, its projected size picks the level of detail
+			glm::vec3 center;
+			float radius;
 		};
 
-		struct Texture
+		// World space bounds and the levels of detail of every object, in the order of objectInfos
+		struct CullObjectShaderData
 		{
-			vk::Image texImage;
-			vk::DeviceMemory texMemory;
-			vk::ImageView texImageView;
+			glm::vec3 center;
+			float radius;
+			glm::vec3 extent;
+			uint32_t lodCount;
+			SceneData::Lod lods [ SceneData::maxLods ];
 		};
 
+		struct CullUniformBlock
+		{
+			Frustum frustum;
+
+			glm::vec3 cameraPosition;
+			float lodScale;
+
+			// The camera the depth pyramid was drawn with
+			glm::mat4 depthPyramidViewProjection;
+			glm::vec2 depthPyramidExtent;
+
+			// Resident objects, the first ones in order
+			uint32_t objectCount;
+
+			// This frame's regions of the command and count buffers
+			uint32_t firstDrawCommand;
+			uint32_t drawCountIndex;
+
+			uint32_t occlusionCulling;
+
+			float lodScreenSize;
+		};
+
+		uint32_t SelectLod ( ObjectInfo const & ) const;
+
 		Dependencies deps;
 
 		vk::Sampler sampler;
-		vk::DescriptorSetLayout materialDSetLayout;
+		vk::DescriptorSetLayout sceneDSetLayout;
 		vk::DescriptorSetLayout texturesDSetLayout;
 		vk::DescriptorSetLayout cameraDSetLayout;
 
 		vk::PipelineLayout pipelineLayout;
 		vk::Pipeline graphicsPipeline;
-		vk::CommandPool transferCommandPool;
 		vk::DescriptorPool descriptorPool;
 
+		// Upper bound of the texture table, each scene's table is only as large as its texture count
+		static inline constexpr uint32_t maxTextures { 4096 };
+
+		// Bytes of geometry, and separately of textures, Update uploads per frame. An object or texture started within it is uploaded whole
+		static inline constexpr vk::DeviceSize streamBudget { 2 * 1024 * 1024 };
+
+		// Projected radius, as a fraction of half the viewport height, below which objects drop to their first simplified level.
+		// Every further halving drops another level, each of which has about half the triangles and twice the error
+		static inline constexpr float lodScreenSize { 0.2f };
+
+		// Invocations per workgroup of the culling shader, and per side of the depth reduction shader's square ones
+		static inline constexpr uint32_t cullWorkgroupSize { 64 };
+		static inline constexpr uint32_t depthReductionWorkgroupSize { 8 };
+
+		// Without multi draw indirect and non zero first instances objects are culled on the CPU and every draw is recorded directly
+		bool indirectDraws;
+
+		// Without draw indirect count culled objects stay in the command buffer with no instances.
+		// Fixed for the device, so the culling shader is specialized for it rather than branching on a uniform
+		bool compactDraws;
+		uint32_t maxDrawIndirectCount;
+
+		// Indirect draws and a scene within maxDrawIndirectCount
+		bool gpuCulling { false };
+		bool occlusionCulling { true };
+
+		vk::DescriptorSetLayout cullDSetLayout;
+		vk::DescriptorSetLayout depthPyramidDSetLayout;
+		vk::PipelineLayout cullPipelineLayout;
+		vk::Pipeline cullPipeline;
+
+		vk::DescriptorSetLayout depthReductionDSetLayout;
+		vk::PipelineLayout depthReductionPipelineLayout;
+		vk::Pipeline depthReductionPipeline;
+
+		// One copy per frame in flight, selected with a dynamic offset
+		vk::Buffer cullUniformBuffer;
+		VmaAllocation cullUniformBufferAllocation;
+		std::byte * cullUniformBufferData;
+		vk::DeviceSize cullUniformBufferStride;
+
+		// Farthest depth of the previous frame at every level, level 0 is the depth buffer itself
+		vk::Sampler depthSampler;
+		vk::Image depthBuffer {};
+		vk::Extent2D depthBufferExtent {};
+		vk::Image depthPyramid {};
+		VmaAllocation depthPyramidAllocation {};
+		vk::ImageView depthPyramidView {};
+		std::vector <vk::ImageView> depthPyramidLevelViews;
+
+		// Each reduces the level above, or the depth buffer, into its level
+		std::vector <vk::DescriptorSet> depthReductionDescriptorSets;
+		vk::DescriptorSet depthPyramidDescriptorSet;
+
+		// Cleared when the depth buffer changes or occlusion culling was off, until the pyramid is built again
+		bool depthPyramidValid { false };
+		glm::mat4 depthPyramidViewProjection;
+
 		vk::Buffer vertexBuffer {};
-		vk::DeviceMemory vertexBufferMemory {};
+		VmaAllocation vertexBufferAllocation {};
 
 		uint32_t indexCount { 0 };
 		vk::Buffer indexBuffer {};
-		vk::DeviceMemory indexBufferMemory {};
+		VmaAllocation indexBufferAllocation {};
 		
-		vk::Buffer materialUniformBuffer;
-		vk::DeviceMemory materialUniformBufferMemory;
-		vk::DescriptorSet materialDescriptorSet;
+		vk::Buffer materialBuffer {};
+		VmaAllocation materialBufferAllocation {};
+		vk::Buffer objectBuffer {};
+		VmaAllocation objectBufferAllocation {};
+		vk::DescriptorSet sceneDescriptorSet;
+
+		// One texture table per frame in flight, a table is only rewritten once its frame's fence is waited on
+		std::vector <vk::DescriptorSet> texturesDescriptorSets;
+		std::vector < std::vector <uint32_t> > pendingTextureSlots;
+
+		vk::Buffer cullObjectBuffer {};
+		VmaAllocation cullObjectBufferAllocation {};
+		vk::DescriptorSet cullDescriptorSet;
 
+		// One region of commands per frame in flight, as many as there are objects, written by the culling shader
+		vk::Buffer drawCommandBuffer {};
+		VmaAllocation drawCommandBufferAllocation {};
+
+		// One count per frame in flight, read back once the frame's fence is waited on
+		vk::Buffer drawCountBuffer {};
+		VmaAllocation drawCountBufferAllocation {};
+		uint32_t * drawCounts;
+
+		// Built for the frame being recorded when culled on the CPU
+		std::vector <vk::DrawIndexedIndirectCommand> drawCommands;
+
+		// One copy per frame in flight, selected with a dynamic offset
+		CameraUniformBlock cameraData;
+		glm::vec3 cameraPosition {};
 		vk::Buffer cameraUniformBuffer;
-		vk::DeviceMemory cameraUniformBufferMemory;
+		VmaAllocation cameraUniformBufferAllocation;
+		std::byte * cameraUniformBufferData;
+		vk::DeviceSize cameraUniformBufferStride;
 		vk::DescriptorSet cameraDescriptorSet;
 
+		// Set once the scene file is read, objects become drawable as they become resident
 		bool sceneLoaded { false };
 
-		std::vector <Texture> textures;
+		std::filesystem::path scenePath;
+		std::chrono::steady_clock::time_point loadStart;
+
+		// Shared with the loader thread, which reads the scene file and then the textures not loaded yet
+		std::shared_ptr <SceneStream> sceneStream;
+		std::jthread sceneLoader;
+
+		// Stopped loaders finish the file they are reading on their own, Update joins those that are done and shutdown the rest
+		std::vector <CancelledSceneLoader> cancelledSceneLoaders;
+
+		// Viewed until all of it is resident
+		std::optional <SceneData> streamingScene;
+		vk::DeviceSize residentVertexBytes { 0 };
+		uint32_t residentObjectCount { 0 };
+		uint32_t residentTextureCount { 0 };
+		uint32_t failedTextureCount { 0 };
+
+		// In the order of the scene's texture table, empty while a slot still shows the white texture of slot 0
+		std::vector < std::optional <TextureCache::Handle> > textures;
 		std::vector <ObjectInfo> objectInfos;
+
+		// World space, in the order of objectInfos
+		BoundingBoxes objectBounds;
+		std::vector <uint32_t> visibleObjects;
+		uint32_t visibleObjectCount { 0 };
 	};
+
+
+
+	// Implementation
+	inline bool Axel::GetOcclusionCulling () const { return occlusionCulling; }
+	inline uint32_t Axel::GetVisibleObjectCount () const { return visibleObjectCount; }
+	inline uint32_t Axel::GetCulledObjectCount () const { return residentObjectCount - visibleObjectCount; }
 }
\ No newline at end of file
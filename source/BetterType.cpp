@@ -12,6 +12,16 @@ namespace pd::bt
 		FT_Done_FreeType ( library );
 	}
 
+	std::shared_ptr <Face> Library::GetFace ( std::string const & path )
+	{
+		if ( auto face { faces [ path ].lock () } )
+			return face;
+
+		auto face { std::make_shared <Face> ( *this, path ) };
+		faces [ path ] = face;
+		return face;
+	}
+
 	Face::Face ( Library & library, std::string const & path )
 		: library ( library )
 	{
@@ -23,35 +33,65 @@ namespace pd::bt
 		FT_Done_Face ( face );
 	}
 
+	FT_Glyph_Metrics const & Face::GetGlyphMetrics ( FT_UInt glyphIndex, int height )
+	{
+		auto metricsIt { glyphMetrics.find ( { height, glyphIndex } ) };
+
+		if ( metricsIt != glyphMetrics.end () )
+			return metricsIt->second;
+
+		// Loading without rendering is enough for the metrics
+		ActivateSize ( height );
+		FT_Load_Glyph ( face, glyphIndex, FT_LOAD_DEFAULT );
+
+		return glyphMetrics.insert ( { { height, glyphIndex }, face->glyph->metrics } ).first->second;
+	}
+
+	FT_Bitmap const & Face::RenderGlyph ( FT_UInt glyphIndex, int height )
+	{
+		ActivateSize ( height );
+		FT_Load_Glyph ( face, glyphIndex, FT_LOAD_RENDER );
+		return face->glyph->bitmap;
+	}
+
+	void Face::ActivateSize ( int height )
+	{
+		if ( face->size == sizes [ height ] )
+			return;
+
+		if ( sizes [ height ] )
+		{
+			FT_Activate_Size ( sizes [ height ] );
+			return;
+		}
+
+		FT_New_Size ( face, &sizes [ height ] );
+		FT_Activate_Size ( sizes [ height ] );
+		FT_Set_Pixel_Sizes ( face, 0, height );
+	}
+
 	Text::Text ( Face & face, std::string const & text, int height, int linePadding )
-		: face ( face )
 	{
 		if ( linePadding == 0 )
 			linePadding = height / 2;
 
 		std::vector < std::vector < FT_Glyph_Metrics > > lineGlyphMetrics { {} };
-		std::vector < std::vector < FT_Bitmap > > lineGlyphBitmaps { {} };
+		std::vector < std::vector < FT_UInt > > lineGlyphIndices { {} };
 
-		// Get glyph bitmap and metrics
+		// Get glyph metrics
 		for ( char ch : text )
 		{
 			if ( ch == '\n' )
 			{
 				lineGlyphMetrics.push_back ( {} );
-				lineGlyphBitmaps.push_back ( {} );
+				lineGlyphIndices.push_back ( {} );
 				continue;
 			}
 
-			FT_Set_Pixel_Sizes ( face.face, 0, height );
-			FT_Load_Glyph ( face.face, FT_Get_Char_Index ( face.face, ch ), 0 );
-
-			if ( face.face->glyph->format != FT_GLYPH_FORMAT_BITMAP )
-				FT_Render_Glyph ( face.face->glyph, FT_RENDER_MODE_NORMAL );
-
-			lineGlyphMetrics.back().push_back (face.face->glyph->metrics);
+			auto glyphIndex { FT_Get_Char_Index ( face.face, ch ) };
 
-			lineGlyphBitmaps.back ().push_back ( {} );
-			FT_Bitmap_Copy ( face.library.library, &face.face->glyph->bitmap, &lineGlyphBitmaps.back ().back() );
+			lineGlyphMetrics.back ().push_back ( face.GetGlyphMetrics ( glyphIndex, height ) );
+			lineGlyphIndices.back ().push_back ( glyphIndex );
 		}
 
 		std::vector <float> lineMaxAscents;
@@ -96,7 +136,7 @@ namespace pd::bt
 					static_cast < float > ( metrics.height / 64 )
 				};
 
-				glyphs.push_back ( { lineGlyphBitmaps [lineIndex] [ glyphIndex ], position, size } );
+				glyphs.push_back ( { lineGlyphIndices [ lineIndex ] [ glyphIndex ], position, size } );
 
 				penPosition.x += metrics.horiAdvance / 64;
 				lineWidth += static_cast < float > ( metrics.horiAdvance / 64 );
@@ -113,10 +153,4 @@ namespace pd::bt
 
 		this->size.y = penPosition.y - lineAdvance + lineMaxDescents.back ();
 	}
-
-	Text::~Text ()
-	{
-		for ( auto & glyph : glyphs )
-			FT_Bitmap_Done ( face.library.library, &glyph.bitmap );
-	}
 }
\ No newline at end of file
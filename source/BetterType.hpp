@@ -2,14 +2,20 @@
 
 namespace pd::bt
 {
+	class Face;
+
 	class Library
 	{
 	public:
 		Library ();
 		~Library ();
 
+		// Opens the font file only if no one holds a face for it yet
+		std::shared_ptr <Face> GetFace ( std::string const & path );
+
 	private:
 		FT_Library library;
+		std::unordered_map < std::string, std::weak_ptr <Face> > faces;
 
 		friend class Face;
 		friend class Text;
@@ -21,9 +27,20 @@ namespace pd::bt
 		Face ( Library &, std::string const & path );
 		~Face ();
 
+		FT_Glyph_Metrics const & GetGlyphMetrics ( FT_UInt glyphIndex, int height );
+
+		// The bitmap stays valid until the next glyph is loaded from this face
+		FT_Bitmap const & RenderGlyph ( FT_UInt glyphIndex, int height );
+
 	private:
+		void ActivateSize ( int height );
+
 		Library & library;
 		FT_Face face;
+
+		// Scaled size objects, released along with the face
+		std::unordered_map < int, FT_Size > sizes;
+		std::map < std::pair < int, FT_UInt >, FT_Glyph_Metrics > glyphMetrics;
 		
 		friend class Text;
 	};
@@ -31,21 +48,20 @@ namespace pd::bt
 	class Text
 	{
 	public:
+		// Layout only, rasterise with Face::RenderGlyph
 		struct Glyph
 		{
-			FT_Bitmap bitmap;
+			FT_UInt index;
 			glm::vec2 position;
 			glm::vec2 size;
 		};
 
 		Text ( Face &, std::string const & text, int height, int linePadding = 0 );
-		~Text ();
 
 		std::vector <Glyph> const & GetGlyphs () const;
 		glm::vec2 const & GetSize () const;
 
 	private:
-		Face & face;
 		glm::vec2 size;
 		std::vector <Glyph> glyphs;
 	};
@@ -13,6 +13,7 @@ namespace pd
 		void Move ( glm::vec3 const & delta );
 		void PitchYaw ( float pitch, float yaw );
 
+		glm::vec3 const & GetPosition () const;
 		glm::mat4 const & GetViewMatrix () const;
 		glm::mat4 const & GetProjectionMatrix () const;
 
@@ -27,6 +28,7 @@ namespace pd
 
 
 	// Implementation
+	inline glm::vec3 const & Camera::GetPosition () const { return position; }
 	inline glm::mat4 const & Camera::GetViewMatrix () const { return viewMatrix; }
 	inline glm::mat4 const & Camera::GetProjectionMatrix () const { return projectionMatrix; }
 }
\ No newline at end of file
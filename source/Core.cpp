@@ -1,4 +1,7 @@
 #include "Core.hpp"
+#include "StagingRing.hpp"
+#include "TextureFile.hpp"
+#include "Shaders.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -132,7 +135,34 @@ namespace pd
 			std::vector <float> queuePriorities { 1.0f };
 			std::vector <vk::DeviceQueueCreateInfo> queueCreateInfos { { {}, static_cast < uint32_t > ( allInOneQueueFamilyIndex ), queuePriorities } };
 			std::vector < char const * > extensions { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-			vk::DeviceCreateInfo createInfo ( {}, queueCreateInfos, {}, extensions, {} );
+
+			vk::PhysicalDeviceVulkan12Features vulkan12Features {};
+			vulkan12Features.timelineSemaphore = VK_TRUE;
+
+			// Texture tables indexed per instance, see Recterer
+			vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+			vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+			vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+			// Scene texture tables sized to the scene, see Axel
+			vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+
+			// Draws compacted by Axel's culling shader where the device can take their count from a buffer
+			auto supportedVulkan12Features { physicalDevice.getFeatures2 <vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features> ()
+				.get <vk::PhysicalDeviceVulkan12Features> () };
+			vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
+			auto supportedFeatures { physicalDevice.getFeatures () };
+			vk::PhysicalDeviceFeatures features {};
+
+			// Block compressed textures where the device has them, see TextureFile
+			features.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+			// Batched indirect draws whose first instance indexes per object data, see Axel
+			features.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+			features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+			vk::DeviceCreateInfo createInfo ( {}, queueCreateInfos, {}, extensions, &features, &vulkan12Features );
 			device = physicalDevice.createDevice ( createInfo );
 
 			queueConfiguration.graphicsQueueFamilyIndex
@@ -189,29 +219,32 @@ namespace pd
 		return device.createSwapchainKHR ( createInfo );
 	}
 
-	vk::RenderPass CreateRenderPass ( vk::Device device, vk::Format outputFormat )
+	vk::RenderPass CreateRenderPass ( vk::Device device, vk::Format outputFormat, RenderPassStage stage )
 	{
+		auto scene { stage == RenderPassStage::scene };
+
 		vk::AttachmentDescription outputAttachment {
 			{},
 			outputFormat,
 			vk::SampleCountFlagBits::e1,
-			vk::AttachmentLoadOp::eClear,
+			scene ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
 			vk::AttachmentStoreOp::eStore,
 			vk::AttachmentLoadOp::eDontCare,
 			vk::AttachmentStoreOp::eDontCare,
-			vk::ImageLayout::eUndefined,
-			vk::ImageLayout::ePresentSrcKHR
+			scene ? vk::ImageLayout::eUndefined : vk::ImageLayout::eColorAttachmentOptimal,
+			scene ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::ePresentSrcKHR
 		};
 		
+		// Kept after the scene pass for Axel's depth pyramid and the overlay's depth tests
 		vk::AttachmentDescription depthAttachment {
 			{},
 			vk::Format::eD32Sfloat,
 			vk::SampleCountFlagBits::e1,
-			vk::AttachmentLoadOp::eClear,
-			vk::AttachmentStoreOp::eDontCare,
+			scene ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
+			scene ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare,
 			vk::AttachmentLoadOp::eDontCare,
 			vk::AttachmentStoreOp::eDontCare,
-			vk::ImageLayout::eUndefined,
+			scene ? vk::ImageLayout::eUndefined : vk::ImageLayout::eDepthStencilAttachmentOptimal,
 			vk::ImageLayout::eDepthStencilAttachmentOptimal
 		};
 
@@ -233,6 +266,29 @@ namespace pd
 		auto attachments = { outputAttachment, depthAttachment };
 		auto subpasses = { subpass };
 
+		// The overlay loads what the scene pass wrote
+		vk::SubpassDependency overlayDependency
+		{
+			VK_SUBPASS_EXTERNAL,
+			0,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+				| vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+		};
+
+		// Every frame in flight shares the depth buffer, the clear waits for the previous frame's overlay to be done with it
+		vk::SubpassDependency sceneDependency
+		{
+			VK_SUBPASS_EXTERNAL,
+			0,
+			vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eEarlyFragmentTests,
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+		};
+
 		vk::RenderPassCreateInfo createInfo
 		{
 			{},
@@ -241,6 +297,8 @@ namespace pd
 			{} // Subpass dependencies
 		};
 
+		createInfo.setDependencies ( scene ? sceneDependency : overlayDependency );
+
 		return device.createRenderPass ( createInfo );
 	}
 
@@ -311,24 +369,16 @@ namespace pd
 		return device.createPipelineLayout ( createInfo );
 	}
 
-	vk::ShaderModule CreateShaderModuleFromFile ( vk::Device device, std::string const & filePath )
+	vk::ShaderModule CreateShaderModule ( vk::Device device, std::span <uint32_t const> code )
 	{
-		std::ifstream file { filePath, std::ios::ate | std::ios::binary };
-		auto size { file.tellg () };
-		file.seekg ( 0 );
-		std::string data { ( std::ostringstream {} << file.rdbuf () ).str () };
-
-		std::vector <uint32_t> code ( size );
-		std::memcpy ( code.data (), data.data (), data.size () );
-
-		vk::ShaderModuleCreateInfo createInfo { {}, static_cast < size_t > ( size ), code.data () };
+		vk::ShaderModuleCreateInfo createInfo { {}, code.size_bytes (), code.data () };
 		return device.createShaderModule ( createInfo );
 	}
 
 	vk::Pipeline CreateGraphicsPipeline ( GraphicsPipelineCreateInfo const & info )
 	{
-		vk::ShaderModule vertexShader { CreateShaderModuleFromFile ( info.device, "shader/build/shader.spv.vert" ) };
-		vk::ShaderModule fragmentShader { CreateShaderModuleFromFile ( info.device, "shader/build/shader.spv.frag" ) };
+		vk::ShaderModule vertexShader { CreateShaderModule ( info.device, shader::sceneVertexShader ) };
+		vk::ShaderModule fragmentShader { CreateShaderModule ( info.device, shader::sceneFragmentShader ) };
 
 		std::vector <vk::PipelineShaderStageCreateInfo> shaderStages
 		{
@@ -428,7 +478,7 @@ namespace pd
 			info.subpass,
 		};
 
-		auto pipeline { info.device.createGraphicsPipeline ( {}, createInfo ).value };
+		auto pipeline { info.device.createGraphicsPipeline ( info.pipelineCache, createInfo ).value };
 
 		info.device.destroy ( vertexShader );
 		info.device.destroy ( fragmentShader );
@@ -436,21 +486,39 @@ namespace pd
 		return pipeline;
 	}
 
+	vk::Pipeline CreateComputePipeline ( vk::Device device, vk::PipelineCache pipelineCache, vk::PipelineLayout pipelineLayout, std::span <uint32_t const> code,
+		vk::SpecializationInfo const * specialization )
+	{
+		vk::ShaderModule shader { CreateShaderModule ( device, code ) };
+
+		vk::ComputePipelineCreateInfo createInfo { {}, { {}, vk::ShaderStageFlagBits::eCompute, shader, "main", specialization }, pipelineLayout };
+		auto pipeline { device.createComputePipeline ( pipelineCache, createInfo ).value };
+
+		device.destroy ( shader );
+
+		return pipeline;
+	}
+
 	void Submit (
 		vk::Queue queue,
 		std::vector <vk::CommandBuffer> const & commandBuffers,
 		vk::Fence signalFence,
 		std::vector <vk::Semaphore> signalSemaphores,
 		std::vector <vk::Semaphore> const & waitSemaphores,
-		std::vector <vk::PipelineStageFlags> waitStages
+		std::vector <vk::PipelineStageFlags> waitStages,
+		std::vector <uint64_t> const & signalValues,
+		std::vector <uint64_t> const & waitValues
 	)
 	{
+		vk::TimelineSemaphoreSubmitInfo timelineInfo { waitValues, signalValues };
+
 		vk::SubmitInfo info
 		{
 			waitSemaphores,
 			waitStages,
 			commandBuffers,
-			signalSemaphores
+			signalSemaphores,
+			waitValues.empty () && signalValues.empty () ? nullptr : &timelineInfo
 		};
 
 		queue.submit ( { info }, signalFence );
@@ -473,179 +541,240 @@ namespace pd
 		return queue.presentKHR ( presentInfo );
 	}
 
-	vk::Buffer CreateBuffer ( vk::Device device, BufferUsages usage, vk::DeviceSize size )
+	vk::BufferUsageFlags GetBufferUsageFlags ( BufferUsages usage )
 	{
-		vk::BufferUsageFlags vkUsage;
-
 		switch ( usage )
 		{
 		case BufferUsages::vertexBuffer:
-			vkUsage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst;
-			break;
+			return vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst;
 
 		case BufferUsages::indexBuffer:
-			vkUsage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst;
-			break;
+			return vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst;
 
 		case BufferUsages::uniformBuffer:
-			vkUsage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst;
-			break;
+			return vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst;
+
+		case BufferUsages::storageBuffer:
+			return vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+
+		// Written by compute shaders
+		case BufferUsages::indirectBuffer:
+			return vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
 
 		case BufferUsages::stagingBuffer:
-			vkUsage = vk::BufferUsageFlagBits::eTransferSrc;
-			break;
+			return vk::BufferUsageFlagBits::eTransferSrc;
 		}
 
-		return device.createBuffer ( { {}, size, vkUsage } );
+		return {};
 	}
 
-	vk::DeviceMemory AllocateMemory ( vk::PhysicalDevice physicalDevice, vk::Device device, MemoryTypes type, vk::DeviceSize size )
+	// Bytes and allocation counts per owning subsystem
+	struct OwnerMemoryUsage
 	{
-		bool typeFound { false };
-		uint32_t typeIndex { 0 };
-		auto memoryProperties { physicalDevice.getMemoryProperties () };
-
-		switch ( type )
-		{
-		case MemoryTypes::deviceLocal:
-			typeIndex = 0;
-			for ( auto const & type : memoryProperties.memoryTypes )
-			{
-				if ( type.propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal )
-				{
-					if ( memoryProperties.memoryHeaps [ type.heapIndex ].size >= size )
-					{
-						typeFound = true; break;
-					}
-				}
-				++typeIndex;
-			}
-
-			break;
-
-		case MemoryTypes::hostVisible:
-			typeIndex = 0;
-			for ( auto const & type : memoryProperties.memoryTypes )
-			{
-				if ( type.propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent )
-				{		
-					if ( memoryProperties.memoryHeaps [ type.heapIndex ].size >= size )
-					{
-						typeFound = true; break;
-					}
-				}
-				++typeIndex;
-			}
+		vk::DeviceSize bytes { 0 };
+		uint32_t allocationCount { 0 };
+	};
 
-			if ( typeFound ) break;
+	static std::mutex ownerMemoryUsagesMutex;
+	static std::map <std::string, OwnerMemoryUsage> ownerMemoryUsages;
 
-			typeIndex = 0;
-			for ( auto const & type : memoryProperties.memoryTypes )
-			{
-				if ( type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible )
-				{
-					if ( memoryProperties.memoryHeaps [ type.heapIndex ].size >= size )
-					{
-						typeFound = true; break;
-					}
-				}
-				++typeIndex;
-			}
-
-			break;
-		}
+	static void TrackAllocation ( VmaAllocator allocator, VmaAllocation allocation, char const * owner )
+	{
+		vmaSetAllocationName ( allocator, allocation, owner );
 
-		assert ( typeFound );
+		VmaAllocationInfo info;
+		vmaGetAllocationInfo ( allocator, allocation, &info );
 
-		return device.allocateMemory ( { size, typeIndex } );
+		std::scoped_lock lock { ownerMemoryUsagesMutex };
+		auto & usage { ownerMemoryUsages [ owner ] };
+		usage.bytes += info.size;
+		++usage.allocationCount;
 	}
 
-	void UpdateBuffer ( vk::PhysicalDevice physicalDevice, vk::Device device, vk::CommandPool commandPool, 
-		vk::Queue queue, vk::Buffer buffer, void const * data, vk::DeviceSize size, vk::DeviceSize offset )
+	static void UntrackAllocation ( VmaAllocator allocator, VmaAllocation allocation )
 	{
-		vk::Fence uploadFinishedFence { device.createFence ( {} ) };
-
-		vk::Buffer stagingBuffer { CreateBuffer ( device, BufferUsages::stagingBuffer, size ) };
-		vk::DeviceMemory stagingBufferMemory { AllocateMemory ( physicalDevice, device, MemoryTypes::hostVisible, size ) };
-		device.bindBufferMemory ( stagingBuffer, stagingBufferMemory, 0 );
+		VmaAllocationInfo info;
+		vmaGetAllocationInfo ( allocator, allocation, &info );
 
-		auto stagingBufferData { device.mapMemory ( stagingBufferMemory, 0, size, {} ) };
-		std::memcpy ( stagingBufferData, data, size );
-		vk::MappedMemoryRange range { stagingBufferMemory, 0, size };
-		device.flushMappedMemoryRanges ( { range } );
-		device.unmapMemory ( stagingBufferMemory );
+		std::scoped_lock lock { ownerMemoryUsagesMutex };
+		auto & usage { ownerMemoryUsages [ info.pName ] };
+		usage.bytes -= info.size;
+		--usage.allocationCount;
+	}
 
-		auto commandBuffer { device.allocateCommandBuffers ( { commandPool, vk::CommandBufferLevel::ePrimary, 1 } ) [ 0 ] };
+	static void CreateBuffer ( VmaAllocator allocator, char const * owner, BufferUsages usage, vk::DeviceSize size,
+		VmaAllocationCreateInfo const & allocationCreateInfo, vk::Buffer & buffer, VmaAllocation & allocation, VmaAllocationInfo * allocationInfo )
+	{
+		vk::BufferCreateInfo createInfo { {}, size, GetBufferUsageFlags ( usage ) };
+		auto const & vkCreateInfo { static_cast < VkBufferCreateInfo const & > ( createInfo ) };
 
-		vk::CommandBufferBeginInfo beginInfo {};
-		commandBuffer.begin ( beginInfo );
-		vk::BufferCopy copyRegion { 0, offset, size };
-		commandBuffer.copyBuffer ( stagingBuffer, buffer, { copyRegion } );
-		commandBuffer.end ();
+		VkBuffer vkBuffer;
+		auto result { vmaCreateBuffer ( allocator, &vkCreateInfo, &allocationCreateInfo, &vkBuffer, &allocation, allocationInfo ) };
 
-		Submit ( queue, { commandBuffer }, uploadFinishedFence );
-		device.waitForFences ( { uploadFinishedFence }, VK_FALSE, std::numeric_limits <uint64_t>::max () );
+		if ( result != VK_SUCCESS )
+			throw std::runtime_error { "Failed to create buffer" };
 
-		device.destroy ( stagingBuffer );
-		device.free ( stagingBufferMemory );
-		device.destroy ( uploadFinishedFence );
-		device.free ( commandPool, commandBuffer );
+		buffer = vk::Buffer { vkBuffer };
+		TrackAllocation ( allocator, allocation, owner );
 	}
 
-	void CreateBuffer (
-		vk::PhysicalDevice physicalDevice,
-		vk::Device device,
-		vk::CommandPool commandPool,
-		vk::Queue queue,
+	UploadTicket CreateBuffer (
+		VmaAllocator allocator,
+		char const * owner,
+		StagingRing & stagingRing,
 		BufferUsages usage,
 		void const * data,
 		vk::DeviceSize size,
 		vk::Buffer & buffer,
-		vk::DeviceMemory & memory
+		VmaAllocation & allocation
 	)
 	{
-		buffer = CreateBuffer ( device, usage, size );
-		memory = AllocateMemory ( physicalDevice, device, MemoryTypes::deviceLocal, size );
-		device.bindBufferMemory ( buffer, memory, 0 );
-		UpdateBuffer ( physicalDevice, device, commandPool, queue, buffer, data, size );
+		CreateBuffer ( allocator, owner, usage, size, buffer, allocation );
+		return stagingRing.UpdateBuffer ( buffer, data, size );
 	}
 
 	void CreateBuffer (
-		vk::PhysicalDevice physicalDevice,
-		vk::Device device,
+		VmaAllocator allocator,
+		char const * owner,
 		BufferUsages usage,
 		vk::DeviceSize size,
 		vk::Buffer & buffer,
-		vk::DeviceMemory & memory
+		VmaAllocation & allocation
 	)
 	{
-		buffer = CreateBuffer ( device, usage, size );
-		memory = AllocateMemory ( physicalDevice, device, MemoryTypes::deviceLocal, size );
-		device.bindBufferMemory ( buffer, memory, 0 );
+		VmaAllocationCreateInfo allocationCreateInfo {};
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+		CreateBuffer ( allocator, owner, usage, size, allocationCreateInfo, buffer, allocation, nullptr );
+	}
+
+	void * CreateMappedBuffer (
+		VmaAllocator allocator,
+		char const * owner,
+		BufferUsages usage,
+		vk::DeviceSize size,
+		vk::Buffer & buffer,
+		VmaAllocation & allocation
+	)
+	{
+		VmaAllocationCreateInfo allocationCreateInfo {};
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+		allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+		VmaAllocationInfo allocationInfo;
+		CreateBuffer ( allocator, owner, usage, size, allocationCreateInfo, buffer, allocation, &allocationInfo );
+
+		return allocationInfo.pMappedData;
+	}
+
+	vk::DeviceSize GetUniformBufferStride ( vk::PhysicalDevice physicalDevice, vk::DeviceSize size )
+	{
+		auto alignment { physicalDevice.getProperties ().limits.minUniformBufferOffsetAlignment };
+		return ( size + alignment - 1 ) / alignment * alignment;
+	}
+
+	void DestroyBuffer ( VmaAllocator allocator, vk::Buffer buffer, VmaAllocation allocation )
+	{
+		if ( ! allocation )
+			return;
+
+		UntrackAllocation ( allocator, allocation );
+		vmaDestroyBuffer ( allocator, static_cast < VkBuffer > ( buffer ), allocation );
+	}
+
+	static void CreateImage ( VmaAllocator allocator, char const * owner, vk::ImageCreateInfo const & createInfo,
+		vk::Image & image, VmaAllocation & allocation )
+	{
+		VmaAllocationCreateInfo allocationCreateInfo {};
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+		auto const & vkCreateInfo { static_cast < VkImageCreateInfo const & > ( createInfo ) };
+
+		VkImage vkImage;
+		auto result { vmaCreateImage ( allocator, &vkCreateInfo, &allocationCreateInfo, &vkImage, &allocation, nullptr ) };
+
+		if ( result != VK_SUCCESS )
+			throw std::runtime_error { "Failed to create image" };
+
+		image = vk::Image { vkImage };
+		TrackAllocation ( allocator, allocation, owner );
+	}
+
+	void DestroyImage ( VmaAllocator allocator, vk::Image image, VmaAllocation allocation )
+	{
+		if ( ! allocation )
+			return;
+
+		UntrackAllocation ( allocator, allocation );
+		vmaDestroyImage ( allocator, static_cast < VkImage > ( image ), allocation );
+	}
+
+	void PrintMemoryReport ( VmaAllocator allocator )
+	{
+		std::cout << "Memory usage by subsystem:" << std::endl;
+
+		{
+			std::scoped_lock lock { ownerMemoryUsagesMutex };
+
+			for ( auto const & [ owner, usage ] : ownerMemoryUsages )
+				std::cout << "  " << owner << ": " << usage.bytes / 1024 << " KiB in " << usage.allocationCount << " allocations" << std::endl;
+		}
+
+		VmaTotalStatistics statistics;
+		vmaCalculateStatistics ( allocator, &statistics );
+
+		std::cout << "  Total: " << statistics.total.statistics.allocationCount << " allocations in "
+			<< statistics.total.statistics.blockCount << " device memory blocks" << std::endl;
+
+		VkPhysicalDeviceMemoryProperties const * memoryProperties;
+		vmaGetMemoryProperties ( allocator, &memoryProperties );
+
+		std::vector <VmaBudget> budgets ( memoryProperties->memoryHeapCount );
+		vmaGetHeapBudgets ( allocator, budgets.data () );
+
+		for ( int heapIndex { 0 }; auto const & budget : budgets )
+		{
+			std::cout << "  Heap " << heapIndex << ": " << budget.usage / ( 1024 * 1024 ) << " / "
+				<< budget.budget / ( 1024 * 1024 ) << " MiB" << std::endl;
+
+			++heapIndex;
+		}
 	}
 
-	vk::DescriptorPool CreateDescriptorPool ( vk::Device device )
+	vk::DescriptorPool CreateDescriptorPool ( vk::Device device, uint32_t sampledImageCount )
 	{
 		std::vector <vk::DescriptorPoolSize> poolSizes
 		{
 			{ vk::DescriptorType::eUniformBuffer, 1000 },
 			{ vk::DescriptorType::eSampler, 1000 },
-			{ vk::DescriptorType::eSampledImage, 1000 },
-			{ vk::DescriptorType::eUniformBufferDynamic, 1000 }
+			{ vk::DescriptorType::eSampledImage, sampledImageCount },
+			{ vk::DescriptorType::eUniformBufferDynamic, 1000 },
+			{ vk::DescriptorType::eStorageBuffer, 1000 },
+			{ vk::DescriptorType::eCombinedImageSampler, 1000 },
+			{ vk::DescriptorType::eStorageImage, 1000 }
 		};
 
 		vk::DescriptorPoolCreateInfo info { vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 1000, poolSizes };
 		return device.createDescriptorPool ( info );
 	}
 
-	vk::DescriptorSet AllocateDescriptorSet ( vk::Device device, vk::DescriptorPool pool, vk::DescriptorSetLayout layout )
+	vk::DescriptorSet AllocateDescriptorSet ( vk::Device device, vk::DescriptorPool pool, vk::DescriptorSetLayout layout,
+		std::optional <uint32_t> variableDescriptorCount )
 	{
 		auto layouts = { layout };
-		return device.allocateDescriptorSets ( { pool, layouts } ) [ 0 ];
+		vk::DescriptorSetAllocateInfo allocateInfo { pool, layouts };
+
+		auto descriptorCount { variableDescriptorCount.value_or ( 0 ) };
+		vk::DescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo { 1, &descriptorCount };
+
+		if ( variableDescriptorCount )
+			allocateInfo.pNext = &variableCountInfo;
+
+		return device.allocateDescriptorSets ( allocateInfo ) [ 0 ];
 	}
 	
-	void CreateDepthBuffer ( vk::PhysicalDevice physicalDevice, vk::Device device, 
-		vk::Extent2D extent, vk::Image & image, vk::DeviceMemory & memory, vk::ImageView & imageView )
+	void CreateDepthBuffer ( vk::Device device, VmaAllocator allocator,
+		vk::Extent2D extent, vk::Image & image, VmaAllocation & allocation, vk::ImageView & imageView )
 	{
 		vk::ImageCreateInfo imageCreateInfo
 		{
@@ -657,17 +786,14 @@ namespace pd
 			1,
 			vk::SampleCountFlagBits::e1,
 			vk::ImageTiling::eOptimal,
-			vk::ImageUsageFlagBits::eDepthStencilAttachment,
+			// Sampled into Axel's depth pyramid
+			vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
 			vk::SharingMode::eExclusive,
 			{},
 			vk::ImageLayout::eUndefined
 		};
 
-		image = device.createImage ( imageCreateInfo );
-		
-		auto requirements { device.getImageMemoryRequirements ( image ) };
-		memory = AllocateMemory ( physicalDevice, device, MemoryTypes::deviceLocal, requirements.size );
-		device.bindImageMemory ( image, memory, 0 );
+		CreateImage ( allocator, "Application", imageCreateInfo, image, allocation );
 
 		vk::ImageViewCreateInfo imageViewCreateInfo
 		{
@@ -682,68 +808,124 @@ namespace pd
 		imageView = device.createImageView ( imageViewCreateInfo );
 	}
 
+	void CreateDepthPyramid ( vk::Device device, VmaAllocator allocator, char const * owner, vk::Extent2D extent,
+		vk::Image & image, VmaAllocation & allocation, vk::ImageView & imageView, std::vector <vk::ImageView> & levelViews )
+	{
+		auto mipLevels { GetMipLevelCount ( extent ) };
+
+		vk::ImageCreateInfo imageCreateInfo
+		{
+			{},
+			vk::ImageType::e2D,
+			vk::Format::eR32Sfloat,
+			{ extent.width, extent.height, 1 },
+			mipLevels,
+			1,
+			vk::SampleCountFlagBits::e1,
+			vk::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+			vk::SharingMode::eExclusive,
+			{},
+			vk::ImageLayout::eUndefined
+		};
+
+		CreateImage ( allocator, owner, imageCreateInfo, image, allocation );
+
+		vk::ImageViewCreateInfo imageViewCreateInfo
+		{
+			{},
+			image,
+			vk::ImageViewType::e2D,
+			vk::Format::eR32Sfloat,
+			{ vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity },
+			{ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 }
+		};
+
+		imageView = device.createImageView ( imageViewCreateInfo );
+
+		levelViews.clear ();
+
+		for ( uint32_t level { 0 }; level < mipLevels; ++level )
+		{
+			imageViewCreateInfo.subresourceRange = vk::ImageSubresourceRange { vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 };
+			levelViews.push_back ( device.createImageView ( imageViewCreateInfo ) );
+		}
+	}
+
 	vk::DescriptorSetLayout CreateDescriptorSetLayout ( 
 		vk::Device device, 
 		vk::DescriptorSetLayoutCreateFlags flags, 
-		std::vector <vk::DescriptorSetLayoutBinding> const & bindings )
+		std::vector <vk::DescriptorSetLayoutBinding> const & bindings,
+		std::vector <vk::DescriptorBindingFlags> const & bindingFlags )
 	{
-		return device.createDescriptorSetLayout ( { {}, bindings } );
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo { bindingFlags };
+		vk::DescriptorSetLayoutCreateInfo createInfo { flags, bindings };
+
+		if ( ! bindingFlags.empty () )
+			createInfo.pNext = &bindingFlagsInfo;
+
+		return device.createDescriptorSetLayout ( createInfo );
 	}
 
-	void CreateTexture (
+	UploadTicket CreateTexture (
 		vk::PhysicalDevice physicalDevice,
 		vk::Device device,
-		vk::CommandPool commandPool,
-		vk::Queue queue,
-		uint32_t queueFamilyIndex,
+		VmaAllocator allocator,
+		char const * owner,
+		StagingRing & stagingRing,
 		std::string const & filePath,
 		vk::Image & image,
 		vk::ImageView & imageView,
-		vk::DeviceMemory & memory
+		VmaAllocation & allocation
 	)
 	{
 		std::cout << "Creating texture: " << filePath << std::endl;
 
-		assert ( std::filesystem::exists ( filePath ) );
-
-		int width, height;
 		stbi_set_flip_vertically_on_load ( 1 );
-		auto data { stbi_load ( filePath.data (), &width, &height, nullptr, 4 ) };
+		auto file { LoadTextureFile ( physicalDevice, filePath ) };
 
-		if ( ! data )
-			std::cout << stbi_failure_reason () << std::endl;
-		
-		CreateTexture ( physicalDevice, device, commandPool, queue, queueFamilyIndex, data,
-			{ static_cast < uint32_t > ( width ), static_cast < uint32_t > ( height ) }, 
-			4, image, imageView, memory );
+		CreateTextureImage ( device, allocator, owner, file.extent, file.format, file.mipLevels, image, imageView, allocation );
+
+		// The staging ring holds its own copy of the pixels
+		auto ticket { stagingRing.UploadImages ( { { image, file.data, file.extent, file.format, file.mipLevels } } ) };
 		
 		std::cout << "Done" << std::endl;
+
+		return ticket;
 	}
 	
-	void CreateTexture (
-		vk::PhysicalDevice physicalDevice,
+	UploadTicket CreateTexture (
 		vk::Device device,
-		vk::CommandPool commandPool,
-		vk::Queue queue,
-		uint32_t queueFamilyIndex,
-		unsigned char * data,
+		VmaAllocator allocator,
+		char const * owner,
+		StagingRing & stagingRing,
+		unsigned char const * data,
 		vk::Extent2D extent,
 		unsigned int components,
+		uint32_t mipLevels,
 		vk::Image & image,
 		vk::ImageView & imageView,
-		vk::DeviceMemory & memory
+		VmaAllocation & allocation
 	)
 	{
-		auto size { static_cast < vk::DeviceSize > ( extent.width * extent.height * components ) };
-
-		auto format {
-			components == 4 ? vk::Format::eR8G8B8A8Srgb
-			: components == 3 ? vk::Format::eR8G8B8Srgb
-			: components == 2 ? vk::Format::eR8G8Srgb
-			: vk::Format::eR8Srgb
+		auto format { GetTextureFormat ( components ) };
 
-		};
+		CreateTextureImage ( device, allocator, owner, extent, format, mipLevels, image, imageView, allocation );
+		return stagingRing.UploadImages ( { { image, data, extent, format, mipLevels } } );
+	}
 
+	void CreateTextureImage (
+		vk::Device device,
+		VmaAllocator allocator,
+		char const * owner,
+		vk::Extent2D extent,
+		vk::Format format,
+		uint32_t mipLevels,
+		vk::Image & image,
+		vk::ImageView & imageView,
+		VmaAllocation & allocation
+	)
+	{
 		{
 			vk::ImageCreateInfo createInfo
 			{
@@ -751,23 +933,20 @@ namespace pd
 				vk::ImageType::e2D,
 				format,
 				{ extent.width, extent.height, 1 },
-				1,
+				mipLevels,
 				1,
 				vk::SampleCountFlagBits::e1,
 				vk::ImageTiling::eOptimal,
-				vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+				// Mips may be blitted from the level above
+				vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc,
 				{},
 				{},
 				vk::ImageLayout::eUndefined
 			};
 
-			image = device.createImage ( createInfo );
+			CreateImage ( allocator, owner, createInfo, image, allocation );
 		}
 
-		auto reqs { device.getImageMemoryRequirements ( image ) };
-		memory = AllocateMemory ( physicalDevice, device, MemoryTypes::deviceLocal, reqs.size );
-		device.bindImageMemory ( image, memory, 0 );
-
 		{
 			vk::ImageViewCreateInfo createInfo
 			{
@@ -776,75 +955,126 @@ namespace pd
 				vk::ImageViewType::e2D,
 				format,
 				{ vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity, vk::ComponentSwizzle::eIdentity },
-				{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
+				{ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 }
 			};
 
 			imageView = device.createImageView ( createInfo );
 		}
+	}
 
-		vk::Fence uploadFinishedFence { device.createFence ( {} ) };
+	vk::Format GetTextureFormat ( unsigned int components )
+	{
+		return components == 4 ? vk::Format::eR8G8B8A8Srgb
+			: components == 3 ? vk::Format::eR8G8B8Srgb
+			: components == 2 ? vk::Format::eR8G8Srgb
+			: vk::Format::eR8Srgb;
+	}
 
-		vk::Buffer stagingBuffer { CreateBuffer ( device, BufferUsages::stagingBuffer, size ) };
-		vk::DeviceMemory stagingBufferMemory { AllocateMemory ( physicalDevice, device, MemoryTypes::hostVisible, size ) };
-		device.bindBufferMemory ( stagingBuffer, stagingBufferMemory, 0 );
+	unsigned int GetTexelSize ( vk::Format format )
+	{
+		switch ( format )
+		{
+			case vk::Format::eR8G8B8A8Srgb: return 4;
+			case vk::Format::eR8G8B8Srgb: return 3;
+			case vk::Format::eR8G8Srgb: return 2;
+			case vk::Format::eR8Srgb: return 1;
+			default: throw std::runtime_error { "Unsupported texture format " + vk::to_string ( format ) };
+		}
+	}
 
-		auto stagingBufferData { device.mapMemory ( stagingBufferMemory, 0, size, {} ) };
-		std::memcpy ( stagingBufferData, data, size );
-		vk::MappedMemoryRange range { stagingBufferMemory, 0, size };
-		device.flushMappedMemoryRanges ( { range } );
-		device.unmapMemory ( stagingBufferMemory );
+	unsigned int GetBlockSize ( vk::Format format )
+	{
+		switch ( format )
+		{
+			case vk::Format::eBc1RgbUnormBlock:
+			case vk::Format::eBc1RgbSrgbBlock:
+			case vk::Format::eBc1RgbaUnormBlock:
+			case vk::Format::eBc1RgbaSrgbBlock:
+				return 8;
+
+			case vk::Format::eBc3UnormBlock:
+			case vk::Format::eBc3SrgbBlock:
+			case vk::Format::eBc7UnormBlock:
+			case vk::Format::eBc7SrgbBlock:
+				return 16;
+
+			default:
+				return 0;
+		}
+	}
 
-		auto commandBuffer { device.allocateCommandBuffers ( { commandPool, vk::CommandBufferLevel::ePrimary, 1 } ) [ 0 ] };
+	vk::DeviceSize GetLevelSize ( vk::Format format, vk::Extent2D extent )
+	{
+		if ( auto blockSize { GetBlockSize ( format ) } )
+			return static_cast < vk::DeviceSize > ( ( extent.width + 3 ) / 4 ) * ( ( extent.height + 3 ) / 4 ) * blockSize;
 
-		vk::CommandBufferBeginInfo beginInfo {};
-		commandBuffer.begin ( beginInfo );
+		return static_cast < vk::DeviceSize > ( extent.width ) * extent.height * GetTexelSize ( format );
+	}
 
-		// Transition layout to transfer dst optimal
-		{
-			vk::ImageMemoryBarrier imageMemoryBarrier (
-				vk::AccessFlagBits::eNone, vk::AccessFlagBits::eTransferWrite,
-				vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
-				queueFamilyIndex, queueFamilyIndex,
-				image, { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
-			);
+	void DownsampleImage ( unsigned char const * source, vk::Extent2D sourceExtent, unsigned char * destination, vk::Extent2D extent, unsigned int components )
+	{
+		static auto const srgbToLinear { [] () {
+			std::array <float, 256> table;
 
-			auto imageMemoryBarriers = { imageMemoryBarrier };
+			for ( int value { 0 }; value < 256; ++value )
+			{
+				auto srgb { value / 255.0f };
+				table [ value ] = srgb <= 0.04045f ? srgb / 12.92f : std::pow ( ( srgb + 0.055f ) / 1.055f, 2.4f );
+			}
 
-			commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eAllCommands,
-				vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, imageMemoryBarriers );
-		}
+			return table;
+		} () };
 
-		// Copy
-		vk::BufferImageCopy copyRegion { 0, 0, 0, { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, {},
-			{ extent.width, extent.height, 1 } };
+		auto linearToSrgb { [] ( float linear ) {
+			auto srgb { linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow ( linear, 1.0f / 2.4f ) - 0.055f };
+			return static_cast < unsigned char > ( std::clamp ( srgb * 255.0f + 0.5f, 0.0f, 255.0f ) );
+		} };
 
-		commandBuffer.copyBufferToImage ( stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, { copyRegion } );
+		auto texel { [ & ] ( uint32_t x, uint32_t y ) {
+			return source + ( static_cast < std::size_t > ( std::min ( y, sourceExtent.height - 1 ) ) * sourceExtent.width
+				+ std::min ( x, sourceExtent.width - 1 ) ) * components;
+		} };
 
-		// Transition layout to shader read only optimal
+		for ( uint32_t y { 0 }; y < extent.height; ++y )
 		{
-			vk::ImageMemoryBarrier imageMemoryBarrier (
-				vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
-				vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
-				queueFamilyIndex, queueFamilyIndex,
-				image,
-				{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
-			);
+			for ( uint32_t x { 0 }; x < extent.width; ++x )
+			{
+				unsigned char const * corners [ 4 ] { texel ( x * 2, y * 2 ), texel ( x * 2 + 1, y * 2 ), texel ( x * 2, y * 2 + 1 ), texel ( x * 2 + 1, y * 2 + 1 ) };
+				auto output { destination + ( static_cast < std::size_t > ( y ) * extent.width + x ) * components };
 
-			auto imageMemoryBarriers = { imageMemoryBarrier };
+				for ( unsigned int component { 0 }; component < components; ++component )
+				{
+					// Alpha is stored linearly
+					if ( components == 4 && component == 3 )
+					{
+						unsigned int sum { 2 };
 
-			commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eTransfer,
-				vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlagBits::eByRegion, {}, {}, imageMemoryBarriers );
-		}
+						for ( auto corner : corners )
+							sum += corner [ component ];
 
-		commandBuffer.end ();
+						output [ component ] = static_cast < unsigned char > ( sum / 4 );
+						continue;
+					}
+
+					float sum { 0.0f };
 
-		Submit ( queue, { commandBuffer }, uploadFinishedFence );
-		device.waitForFences ( { uploadFinishedFence }, VK_FALSE, std::numeric_limits <uint64_t>::max () );
+					for ( auto corner : corners )
+						sum += srgbToLinear [ corner [ component ] ];
+
+					output [ component ] = linearToSrgb ( sum / 4.0f );
+				}
+			}
+		}
+	}
 
-		device.destroy ( stagingBuffer );
-		device.free ( stagingBufferMemory );
-		device.destroy ( uploadFinishedFence );
-		device.free ( commandPool, commandBuffer );
+	uint32_t GetMipLevelCount ( vk::Extent2D extent )
+	{
+		return static_cast < uint32_t > ( std::bit_width ( std::max ( { extent.width, extent.height, 1u } ) ) );
+	}
+
+	vk::Extent2D GetMipLevelExtent ( vk::Extent2D extent, uint32_t level )
+	{
+		return { std::max ( extent.width >> level, 1u ), std::max ( extent.height >> level, 1u ) };
 	}
 
 	vk::Sampler CreateDefaultSampler ( vk::Device device )
@@ -864,7 +1094,32 @@ namespace pd
 			VK_FALSE,
 			vk::CompareOp::eNever,
 			0.0f,
+			VK_LOD_CLAMP_NONE,
+			vk::BorderColor::eFloatOpaqueBlack,
+			VK_FALSE
+		};
+
+		return device.createSampler ( createInfo );
+	}
+
+	vk::Sampler CreateNearestSampler ( vk::Device device )
+	{
+		vk::SamplerCreateInfo createInfo
+		{
+			{},
+			vk::Filter::eNearest,
+			vk::Filter::eNearest,
+			vk::SamplerMipmapMode::eNearest,
+			vk::SamplerAddressMode::eClampToEdge,
+			vk::SamplerAddressMode::eClampToEdge,
+			vk::SamplerAddressMode::eClampToEdge,
+			0.0F,
+			VK_FALSE,
+			0.0f,
+			VK_FALSE,
+			vk::CompareOp::eNever,
 			0.0f,
+			VK_LOD_CLAMP_NONE,
 			vk::BorderColor::eFloatOpaqueBlack,
 			VK_FALSE
 		};
@@ -901,4 +1156,44 @@ namespace pd
 
 		return translationMat * scaleMat;
 	}
-}
\ No newline at end of file
+
+	void ParallelFor ( std::size_t count, std::function <void ( std::size_t )> const & function )
+	{
+		auto threadCount { std::min <std::size_t> ( count, std::max ( 1u, std::thread::hardware_concurrency () ) ) };
+
+		std::atomic <std::size_t> nextIndex { 0 };
+		std::exception_ptr exception;
+		std::mutex exceptionMutex;
+
+		auto work { [ & ] () {
+			for ( auto index { nextIndex++ }; index < count; index = nextIndex++ )
+			{
+				try
+				{
+					function ( index );
+				}
+				catch ( ... )
+				{
+					std::scoped_lock lock { exceptionMutex };
+
+					if ( ! exception )
+						exception = std::current_exception ();
+				}
+			}
+		} };
+
+		// The calling thread works too instead of just waiting
+		std::vector <std::thread> threads;
+
+		for ( std::size_t thread { 1 }; thread < threadCount; ++thread )
+			threads.emplace_back ( work );
+
+		work ();
+
+		for ( auto & thread : threads )
+			thread.join ();
+
+		if ( exception )
+			std::rethrow_exception ( exception );
+	}
+}
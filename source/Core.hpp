@@ -2,6 +2,11 @@
 
 namespace pd
 {
+	class StagingRing;
+
+	// Timeline value at which an upload recorded into a StagingRing has completed
+	using UploadTicket = uint64_t;
+
 	std::vector < char const * > GetWindowRequiredVulkanExtensions ( SDL_Window * window );
 	glm::vec2 GetWindowSize ( SDL_Window * window );
 	glm::vec2 GetMousePosition ();
@@ -33,11 +38,14 @@ namespace pd
 	void CreateDevice ( vk::PhysicalDevice, vk::SurfaceKHR surface, vk::Device &, DeviceQueues & );
 	vk::SurfaceFormatKHR SelectSurfaceFormat ( vk::PhysicalDevice, vk::SurfaceKHR );
 	vk::SwapchainKHR CreateSwapchain ( vk::PhysicalDevice, vk::Device, vk::SurfaceKHR, vk::SurfaceFormatKHR const &, glm::vec2 const & size, vk::SwapchainKHR oldSwapchain = {} );
-	vk::RenderPass CreateRenderPass ( vk::Device, vk::Format outputFormat );
+	// The scene pass clears and keeps its depth, so it can be read before the overlay pass loads both attachments and draws on top
+	enum class RenderPassStage { scene, overlay };
+
+	vk::RenderPass CreateRenderPass ( vk::Device, vk::Format outputFormat, RenderPassStage );
 	std::vector <vk::ImageView> CreateSwapchainImageViews ( vk::Device, vk::SwapchainKHR, vk::Format format );
 	std::vector <vk::Framebuffer> CreateFramebuffers ( vk::Device, vk::RenderPass, std::vector <vk::ImageView> attachments, vk::ImageView depthAttachment, glm::vec2 const & size );
 	vk::PipelineLayout CreatePipelineLayout ( vk::Device, std::vector <vk::DescriptorSetLayout> const & = {}, std::vector <vk::PushConstantRange> const & pushConstantRanges = {} );
-	vk::ShaderModule CreateShaderModuleFromFile ( vk::Device, std::string const & filePath );
+	vk::ShaderModule CreateShaderModule ( vk::Device, std::span <uint32_t const> code );
 
 	struct GraphicsPipelineCreateInfo
 	{
@@ -45,9 +53,13 @@ namespace pd
 		vk::RenderPass renderPass;
 		uint32_t subpass;
 		vk::PipelineLayout pipelineLayout;
+		vk::PipelineCache pipelineCache;
 	};
 
 	vk::Pipeline CreateGraphicsPipeline ( GraphicsPipelineCreateInfo const & );
+	// The specialization, when given, sets the shader's specialization constants, see Shaders.hpp
+	vk::Pipeline CreateComputePipeline ( vk::Device, vk::PipelineCache, vk::PipelineLayout, std::span <uint32_t const> code,
+		vk::SpecializationInfo const * specialization = nullptr );
 	
 	void Submit ( 
 		vk::Queue, 
@@ -55,72 +67,128 @@ namespace pd
 		vk::Fence signalFence = {},
 		std::vector <vk::Semaphore> signalSemaphores = {},
 		std::vector <vk::Semaphore> const & waitSemaphores = {},
-		std::vector <vk::PipelineStageFlags> waitStages = {}
+		std::vector <vk::PipelineStageFlags> waitStages = {},
+		std::vector <uint64_t> const & signalValues = {},
+		std::vector <uint64_t> const & waitValues = {}
 	);
 
 	vk::Result Present ( vk::Queue, vk::SwapchainKHR, uint32_t imageIndex, vk::Semaphore waitSemaphore );
-	enum class BufferUsages { vertexBuffer, indexBuffer, uniformBuffer, stagingBuffer };
-	vk::Buffer CreateBuffer ( vk::Device, BufferUsages, vk::DeviceSize size );
-	enum class MemoryTypes { hostVisible, deviceLocal };
-	vk::DeviceMemory AllocateMemory ( vk::PhysicalDevice, vk::Device, MemoryTypes, vk::DeviceSize size );
-	
-	void UpdateBuffer ( vk::PhysicalDevice physicalDevice, vk::Device device, vk::CommandPool commandPool,
-		vk::Queue queue, vk::Buffer buffer, void const * data, vk::DeviceSize size, vk::DeviceSize offset = 0 );
-
-	void CreateBuffer ( 
-		vk::PhysicalDevice,
-		vk::Device,
-		vk::CommandPool,
-		vk::Queue,
+	enum class BufferUsages { vertexBuffer, indexBuffer, uniformBuffer, storageBuffer, indirectBuffer, stagingBuffer };
+	vk::BufferUsageFlags GetBufferUsageFlags ( BufferUsages );
+
+	// Every allocation is tagged with the subsystem that owns it, see PrintMemoryReport
+	UploadTicket CreateBuffer ( 
+		VmaAllocator,
+		char const * owner,
+		StagingRing &,
 		BufferUsages usage,
 		void const * data,
 		vk::DeviceSize size,
 		vk::Buffer &, 
-		vk::DeviceMemory & 
+		VmaAllocation & 
 	);
 
 	void CreateBuffer (
-		vk::PhysicalDevice,
-		vk::Device,
+		VmaAllocator,
+		char const * owner,
+		BufferUsages usage,
+		vk::DeviceSize,
+		vk::Buffer &,
+		VmaAllocation &
+	);
+
+	// Host visible and persistently mapped, returns the mapping
+	void * CreateMappedBuffer (
+		VmaAllocator,
+		char const * owner,
 		BufferUsages usage,
 		vk::DeviceSize,
 		vk::Buffer &,
-		vk::DeviceMemory &
+		VmaAllocation &
 	);
 
-	vk::DescriptorPool CreateDescriptorPool ( vk::Device );
-	vk::DescriptorSet AllocateDescriptorSet ( vk::Device, vk::DescriptorPool, vk::DescriptorSetLayout );
-	void CreateDepthBuffer ( vk::PhysicalDevice, vk::Device, vk::Extent2D, vk::Image &, vk::DeviceMemory &, vk::ImageView & );
-	vk::DescriptorSetLayout CreateDescriptorSetLayout ( vk::Device, vk::DescriptorSetLayoutCreateFlags, std::vector <vk::DescriptorSetLayoutBinding> const & );
+	// Size of one element in a buffer bound at a different dynamic offset each frame
+	vk::DeviceSize GetUniformBufferStride ( vk::PhysicalDevice, vk::DeviceSize size );
+
+	void DestroyBuffer ( VmaAllocator, vk::Buffer, VmaAllocation );
+	void DestroyImage ( VmaAllocator, vk::Image, VmaAllocation );
+	void PrintMemoryReport ( VmaAllocator );
+
+	vk::DescriptorPool CreateDescriptorPool ( vk::Device, uint32_t sampledImageCount = 8192 );
+	// The variable count, when given, sizes the layout's last binding if it was created with a variable descriptor count
+	vk::DescriptorSet AllocateDescriptorSet ( vk::Device, vk::DescriptorPool, vk::DescriptorSetLayout, std::optional <uint32_t> variableDescriptorCount = {} );
+	void CreateDepthBuffer ( vk::Device, VmaAllocator, vk::Extent2D, vk::Image &, VmaAllocation &, vk::ImageView & );
+
+	// Single channel float mip chain, with a view of the whole chain for sampling and one per level for storage writes
+	void CreateDepthPyramid ( vk::Device, VmaAllocator, char const * owner, vk::Extent2D, vk::Image &, VmaAllocation &,
+		vk::ImageView &, std::vector <vk::ImageView> & levelViews );
+	// Binding flags, when given, are matched to the bindings by position
+	vk::DescriptorSetLayout CreateDescriptorSetLayout ( vk::Device, vk::DescriptorSetLayoutCreateFlags, std::vector <vk::DescriptorSetLayoutBinding> const &,
+		std::vector <vk::DescriptorBindingFlags> const & bindingFlags = {} );
 	
-	void CreateTexture ( 
+	// Block compressed where the file is, or where the device samples BC formats, see TextureFile
+	UploadTicket CreateTexture ( 
 		vk::PhysicalDevice,
 		vk::Device,
-		vk::CommandPool,
-		vk::Queue,
-		uint32_t queueFamilyIndex,
+		VmaAllocator,
+		char const * owner,
+		StagingRing &,
 		std::string const & filePath,
 		vk::Image &,
 		vk::ImageView &,
-		vk::DeviceMemory &
+		VmaAllocation &
 	);
 
-	void CreateTexture (
-		vk::PhysicalDevice,
+	UploadTicket CreateTexture (
 		vk::Device,
-		vk::CommandPool,
-		vk::Queue,
-		uint32_t queueFamilyIndex,
-		unsigned char * data,
+		VmaAllocator,
+		char const * owner,
+		StagingRing &,
+		unsigned char const * data,
 		vk::Extent2D extent,
 		unsigned int components,
+		uint32_t mipLevels,
+		vk::Image &,
+		vk::ImageView &,
+		VmaAllocation &
+	);
+
+	// Leaves the image in undefined layout, for uploading through the staging ring
+	void CreateTextureImage (
+		vk::Device,
+		VmaAllocator,
+		char const * owner,
+		vk::Extent2D extent,
+		vk::Format,
+		uint32_t mipLevels,
 		vk::Image &,
 		vk::ImageView &,
-		vk::DeviceMemory &
+		VmaAllocation &
 	);
 
+	vk::Format GetTextureFormat ( unsigned int components );
+
+	// Bytes per texel of the formats from GetTextureFormat
+	unsigned int GetTexelSize ( vk::Format );
+
+	// Bytes per 4x4 block of the BC formats, 0 for the others
+	unsigned int GetBlockSize ( vk::Format );
+
+	// Bytes in one level of a tightly packed image
+	vk::DeviceSize GetLevelSize ( vk::Format, vk::Extent2D );
+
+	// Averages 2x2 blocks of texels into the next mip level, in linear space for the sRGB encoded channels
+	void DownsampleImage ( unsigned char const * source, vk::Extent2D sourceExtent, unsigned char * destination, vk::Extent2D extent, unsigned int components );
+
+	// Levels down to 1x1
+	uint32_t GetMipLevelCount ( vk::Extent2D );
+	vk::Extent2D GetMipLevelExtent ( vk::Extent2D, uint32_t level );
+
 	vk::Sampler CreateDefaultSampler ( vk::Device );
 
+	// Nearest texel, clamped to the edge, for reading data rather than colors
+	vk::Sampler CreateNearestSampler ( vk::Device );
+
 	void SetViewport ( vk::CommandBuffer, vk::Extent2D viewport );
 
 
@@ -129,4 +197,7 @@ namespace pd
 		glm::vec3 const & scale = { 1, 1, 1 }
 	);
 
+	// Calls the function for every index in [ 0, count ) across the hardware threads and rethrows the first exception
+	void ParallelFor ( std::size_t count, std::function <void ( std::size_t )> const & );
+
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "Frustum.hpp"
+
+#if defined ( __SSE__ ) || defined ( _M_X64 ) || defined ( _M_IX86 )
+	#include <xmmintrin.h>
+	#define PD_FRUSTUM_SSE
+#endif
+
+namespace pd
+{
+	Frustum GetFrustum ( glm::mat4 const & viewProjection )
+	{
+		auto row { [ & ] ( int index ) {
+			return glm::vec4 { viewProjection [ 0 ][ index ], viewProjection [ 1 ][ index ], viewProjection [ 2 ][ index ], viewProjection [ 3 ][ index ] };
+		} };
+
+		// The near plane is the OpenGL one, which contains the zero to one depth range one too, culling stays conservative either way
+		return {
+			row ( 3 ) + row ( 0 ), row ( 3 ) - row ( 0 ),
+			row ( 3 ) + row ( 1 ), row ( 3 ) - row ( 1 ),
+			row ( 3 ) + row ( 2 ), row ( 3 ) - row ( 2 )
+		};
+	}
+
+	void BoundingBoxes::Add ( glm::vec3 const & min, glm::vec3 const & max )
+	{
+		for ( int axis { 0 }; axis < 3; ++axis )
+		{
+			centers [ axis ].push_back ( ( min [ axis ] + max [ axis ] ) * 0.5f );
+			extents [ axis ].push_back ( ( max [ axis ] - min [ axis ] ) * 0.5f );
+		}
+	}
+
+	void BoundingBoxes::Clear ()
+	{
+		for ( int axis { 0 }; axis < 3; ++axis )
+		{
+			centers [ axis ].clear ();
+			extents [ axis ].clear ();
+		}
+	}
+
+	void BoundingBoxes::Cull ( Frustum const & frustum, std::vector <uint32_t> & visible ) const
+	{
+		auto count { GetCount () };
+		std::size_t first { 0 };
+
+	#ifdef PD_FRUSTUM_SSE
+		__m128 normals [ 6 ][ 3 ], absoluteNormals [ 6 ][ 3 ], distances [ 6 ];
+
+		for ( int plane { 0 }; plane < 6; ++plane )
+		{
+			for ( int axis { 0 }; axis < 3; ++axis )
+			{
+				normals [ plane ][ axis ] = _mm_set1_ps ( frustum [ plane ][ axis ] );
+				absoluteNormals [ plane ][ axis ] = _mm_set1_ps ( std::abs ( frustum [ plane ][ axis ] ) );
+			}
+
+			distances [ plane ] = _mm_set1_ps ( frustum [ plane ].w );
+		}
+
+		for ( ; first + 4 <= count; first += 4 )
+		{
+			__m128 center [ 3 ], extent [ 3 ];
+
+			for ( int axis { 0 }; axis < 3; ++axis )
+			{
+				center [ axis ] = _mm_loadu_ps ( centers [ axis ].data () + first );
+				extent [ axis ] = _mm_loadu_ps ( extents [ axis ].data () + first );
+			}
+
+			auto inside { _mm_cmpeq_ps ( _mm_setzero_ps (), _mm_setzero_ps () ) };
+
+			// A box is outside a plane when even its corner furthest along the normal is behind it
+			for ( int plane { 0 }; plane < 6; ++plane )
+			{
+				auto distance { distances [ plane ] };
+				auto radius { _mm_setzero_ps () };
+
+				for ( int axis { 0 }; axis < 3; ++axis )
+				{
+					distance = _mm_add_ps ( distance, _mm_mul_ps ( normals [ plane ][ axis ], center [ axis ] ) );
+					radius = _mm_add_ps ( radius, _mm_mul_ps ( absoluteNormals [ plane ][ axis ], extent [ axis ] ) );
+				}
+
+				inside = _mm_and_ps ( inside, _mm_cmpge_ps ( _mm_add_ps ( distance, radius ), _mm_setzero_ps () ) );
+			}
+
+			auto mask { _mm_movemask_ps ( inside ) };
+
+			for ( uint32_t lane { 0 }; lane < 4; ++lane )
+			{
+				if ( mask & ( 1 << lane ) )
+					visible.push_back ( static_cast < uint32_t > ( first ) + lane );
+			}
+		}
+	#endif
+
+		for ( ; first < count; ++first )
+		{
+			auto inside { true };
+
+			for ( auto const & plane : frustum )
+			{
+				auto distance { plane.w }, radius { 0.0f };
+
+				for ( int axis { 0 }; axis < 3; ++axis )
+				{
+					distance += plane [ axis ] * centers [ axis ][ first ];
+					radius += std::abs ( plane [ axis ] ) * extents [ axis ][ first ];
+				}
+
+				inside = inside && distance + radius >= 0.0f;
+			}
+
+			if ( inside )
+				visible.push_back ( static_cast < uint32_t > ( first ) );
+		}
+	}
+}
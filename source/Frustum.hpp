@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+	View frustum culling of axis aligned boxes. Boxes are stored a component per array
+	so four of them are tested against a plane at once with SSE, where it is available.
+*/
+
+namespace pd
+{
+	// Each plane is a normal and distance, boxes on the negative side of any one are outside
+	using Frustum = std::array <glm::vec4, 6>;
+
+	Frustum GetFrustum ( glm::mat4 const & viewProjection );
+
+	class BoundingBoxes
+	{
+	public:
+		void Add ( glm::vec3 const & min, glm::vec3 const & max );
+		void Clear ();
+
+		std::size_t GetCount () const;
+
+		// Appends the indices of the boxes at least partly inside
+		void Cull ( Frustum const &, std::vector <uint32_t> & visible ) const;
+
+	private:
+		// Centers and half extents, x, y and z
+		std::array < std::vector <float>, 3 > centers;
+		std::array < std::vector <float>, 3 > extents;
+	};
+
+
+
+	// Implementation
+	inline std::size_t BoundingBoxes::GetCount () const { return centers [ 0 ].size (); }
+}
@@ -0,0 +1,156 @@
+#include "GlyphAtlas.hpp"
+
+namespace pd
+{
+	void GlyphAtlas::Initialize ( Dependencies const & deps, uint32_t pageSize )
+	{
+		this->deps = deps;
+		this->pageSize = pageSize;
+	}
+
+	void GlyphAtlas::Shutdown ()
+	{
+		for ( auto const & page : pages )
+		{
+			deps.stagingRing->DeferDestruction ( [ device = deps.device, allocator = deps.allocator,
+				image = page.image, allocation = page.allocation, view = page.view ] () {
+				device.destroy ( view );
+				DestroyImage ( allocator, image, allocation );
+			} );
+		}
+
+		pages.clear ();
+		entries.clear ();
+	}
+
+	std::optional <GlyphAtlas::Glyph> GlyphAtlas::Acquire ( bt::Face & face, Key const & key )
+	{
+		if ( auto entryIt { entries.find ( key ) }; entryIt != entries.end () )
+		{
+			++entryIt->second.referenceCount;
+			++pages [ entryIt->second.glyph.page ].referenceCount;
+			return entryIt->second.glyph;
+		}
+
+		auto const & bitmap { face.RenderGlyph ( key.glyphIndex, key.height ) };
+
+		if ( ! bitmap.buffer || bitmap.width == 0 || bitmap.rows == 0 )
+			return {};
+
+		vk::Extent2D extent { bitmap.width, bitmap.rows };
+
+		if ( extent.width + padding * 2 > pageSize || extent.height + padding * 2 > pageSize )
+			throw std::runtime_error { "Glyph does not fit in an atlas page" };
+
+		// Rows of the bitmap can be padded, the upload expects them tightly packed
+		std::vector <unsigned char> pixels ( extent.width * extent.height );
+
+		for ( uint32_t row { 0 }; row < extent.height; ++row )
+			std::memcpy ( pixels.data () + row * extent.width, bitmap.buffer + row * bitmap.pitch, extent.width );
+
+		auto [ pageIndex, offset ] { Allocate ( extent ) };
+		auto & page { pages [ pageIndex ] };
+
+		deps.stagingRing->UploadImage ( page.image, pixels.data (), extent, 1, offset, vk::ImageLayout::eShaderReadOnlyOptimal );
+
+		auto size { static_cast < float > ( pageSize ) };
+
+		Entry entry {
+			{ pageIndex, { offset.x / size, offset.y / size, extent.width / size, extent.height / size } },
+			1
+		};
+
+		entries.insert ( { key, entry } );
+		page.keys.push_back ( key );
+		++page.referenceCount;
+
+		return entry.glyph;
+	}
+
+	void GlyphAtlas::Release ( Key const & key )
+	{
+		auto & entry { entries.at ( key ) };
+
+		// Stays cached until its page is needed for other glyphs
+		--entry.referenceCount;
+		--pages [ entry.glyph.page ].referenceCount;
+	}
+
+	std::optional <vk::Offset2D> GlyphAtlas::Pack ( Page & page, vk::Extent2D extent )
+	{
+		auto width { extent.width + padding };
+		auto height { extent.height + padding };
+
+		// Lowest shelf with room that the glyph fits in
+		Shelf * bestShelf { nullptr };
+
+		for ( auto & shelf : page.shelves )
+		{
+			if ( shelf.height >= height && shelf.width + width <= pageSize && ( ! bestShelf || shelf.height < bestShelf->height ) )
+				bestShelf = &shelf;
+		}
+
+		if ( ! bestShelf )
+		{
+			if ( page.shelvesHeight + height > pageSize )
+				return {};
+
+			page.shelves.push_back ( { page.shelvesHeight, height, padding } );
+			page.shelvesHeight += height;
+			bestShelf = &page.shelves.back ();
+		}
+
+		vk::Offset2D offset { static_cast < int32_t > ( bestShelf->width ), static_cast < int32_t > ( bestShelf->y ) };
+		bestShelf->width += width;
+
+		return offset;
+	}
+
+	std::pair <uint32_t, vk::Offset2D> GlyphAtlas::Allocate ( vk::Extent2D extent )
+	{
+		for ( uint32_t index { 0 }; index < pages.size (); ++index )
+		{
+			if ( auto offset { Pack ( pages [ index ], extent ) } )
+				return { index, *offset };
+		}
+
+		// Every page is full, evict one no text is using before growing the atlas
+		for ( uint32_t index { 0 }; index < pages.size (); ++index )
+		{
+			if ( pages [ index ].referenceCount == 0 )
+			{
+				ClearPage ( pages [ index ] );
+				return { index, *Pack ( pages [ index ], extent ) };
+			}
+		}
+
+		AddPage ();
+		return { static_cast < uint32_t > ( pages.size () - 1 ), *Pack ( pages.back (), extent ) };
+	}
+
+	void GlyphAtlas::ClearPage ( Page & page )
+	{
+		for ( auto const & key : page.keys )
+			entries.erase ( key );
+
+		page.keys.clear ();
+		page.shelves.clear ();
+		page.shelvesHeight = padding;
+
+		// Zero the old glyphs so none of them bleed into the padding around new ones
+		std::vector <unsigned char> pixels ( pageSize * pageSize, 0 );
+		deps.stagingRing->UploadImage ( page.image, pixels.data (), { pageSize, pageSize }, 1, {}, vk::ImageLayout::eShaderReadOnlyOptimal );
+	}
+
+	void GlyphAtlas::AddPage ()
+	{
+		Page page;
+
+		std::vector <unsigned char> pixels ( pageSize * pageSize, 0 );
+
+		CreateTexture ( deps.device, deps.allocator, "GlyphAtlas", *deps.stagingRing,
+			pixels.data (), { pageSize, pageSize }, 1, 1, page.image, page.view, page.allocation );
+
+		pages.push_back ( std::move ( page ) );
+	}
+}
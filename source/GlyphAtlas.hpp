@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Core.hpp"
+#include "StagingRing.hpp"
+#include "BetterType.hpp"
+
+/*
+	Rasterised glyphs shared between all texts, packed into pages on shelves.
+	Glyphs are uploaded into their page as they are first used, and a page
+	is cleared for reuse once no text references any glyph on it.
+*/
+
+namespace pd
+{
+	class GlyphAtlas
+	{
+	public:
+		struct Dependencies
+		{
+			vk::Device device;
+			VmaAllocator allocator;
+			StagingRing * stagingRing;
+		};
+
+		struct Key
+		{
+			std::string font;
+			int height;
+			FT_UInt glyphIndex;
+
+			auto operator <=> ( Key const & ) const = default;
+		};
+
+		struct Glyph
+		{
+			uint32_t page;
+
+			// Offset and scale of the glyph's texture coordinates within its page
+			glm::vec4 uvRect;
+		};
+
+		void Initialize ( Dependencies const &, uint32_t pageSize = 1024 );
+		void Shutdown ();
+
+		// Empty if the glyph has no bitmap. Every acquired glyph must be released
+		std::optional <Glyph> Acquire ( bt::Face &, Key const & );
+		void Release ( Key const & );
+
+		uint32_t GetPageCount () const;
+		vk::ImageView GetPageView ( uint32_t page ) const;
+
+	private:
+		static inline constexpr uint32_t padding { 1 };
+
+		struct Shelf
+		{
+			uint32_t y;
+			uint32_t height;
+			uint32_t width;
+		};
+
+		struct Page
+		{
+			vk::Image image;
+			VmaAllocation allocation;
+			vk::ImageView view;
+
+			std::vector <Shelf> shelves;
+			uint32_t shelvesHeight { padding };
+
+			std::vector <Key> keys;
+			uint32_t referenceCount { 0 };
+		};
+
+		struct Entry
+		{
+			Glyph glyph;
+			uint32_t referenceCount { 0 };
+		};
+
+		std::optional <vk::Offset2D> Pack ( Page &, vk::Extent2D );
+		std::pair <uint32_t, vk::Offset2D> Allocate ( vk::Extent2D );
+		void ClearPage ( Page & );
+		void AddPage ();
+
+		Dependencies deps;
+		uint32_t pageSize;
+
+		std::vector <Page> pages;
+		std::map <Key, Entry> entries;
+	};
+
+
+
+	// Implementation
+	inline uint32_t GlyphAtlas::GetPageCount () const { return static_cast < uint32_t > ( pages.size () ); }
+	inline vk::ImageView GlyphAtlas::GetPageView ( uint32_t page ) const { return pages [ page ].view; }
+}
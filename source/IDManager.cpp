@@ -1,47 +1,40 @@
 #include "IDManager.hpp"
 
-#include <numeric>
-
 namespace pd
 {
 	IDManager::IDManager ( int begin, int end )
+		: begin { begin }, end { end }, next { begin }
 	{
-		auto count { end - begin + 1 };
-
-		std::vector <int> ids ( count );
-		std::iota ( ids.begin (), ids.end (), begin );
-
-		idInfos.reserve ( count );
-
-		for ( auto const id : ids )
-			idInfos.push_back ( { id, false } );
 	}
 
 	int IDManager::GetID ()
 	{
-		for ( auto & idInfo : idInfos )
+		int id;
+
+		if ( ! freeIDs.empty () )
 		{
-			if ( ! idInfo.used )
-			{
-				idInfo.used = true;
-				return idInfo.id;
-			}
+			id = freeIDs.top ();
+			freeIDs.pop ();
+		}
+		else
+		{
+			if ( next > end )
+				throw std::runtime_error { "No id available" };
+
+			id = next++;
+			used.push_back ( false );
 		}
 
-		throw std::runtime_error { "No id available" };
+		used [ id - begin ] = true;
+		return id;
 	}
 
 	void IDManager::FreeID ( int id )
 	{
-		for ( auto & idInfo : idInfos )
-		{
-			if ( idInfo.id == id )
-			{
-				idInfo.used = false;
-				return;
-			}
-		}
+		if ( id < begin || id >= next || ! used [ id - begin ] )
+			throw std::runtime_error { "Couldn't find id" };
 
-		throw std::runtime_error { "Couldn't find id" };
+		used [ id - begin ] = false;
+		freeIDs.push ( id );
 	}
 }
\ No newline at end of file
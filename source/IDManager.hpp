@@ -5,18 +5,26 @@ namespace pd
 	class IDManager
 	{
 	public:
-		IDManager ( int begin = 0, int end = 100 );
+		// Hands out the lowest free id in [ begin, end ], freed ids are reused first
+		IDManager ( int begin = 0, int end = std::numeric_limits <int>::max () );
 
 		int GetID ();
 		void FreeID ( int );
 
+		// One past the highest id handed out so far
+		int GetUpperBound () const;
+
 	private:
-		struct IDInfo
-		{
-			int id;
-			bool used { false };
-		};
+		int begin;
+		int end;
+		int next;
 
-		std::vector <IDInfo> idInfos;
+		std::priority_queue < int, std::vector <int>, std::greater <int> > freeIDs;
+		std::vector <bool> used;
 	};
+
+
+
+	// Implementation
+	inline int IDManager::GetUpperBound () const { return next; }
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "MappedFile.hpp"
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace pd
+{
+	MappedFile::MappedFile ( std::filesystem::path const & path )
+	{
+	#ifdef _WIN32
+		file = CreateFileW ( path.c_str (), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+
+		if ( file == INVALID_HANDLE_VALUE )
+			throw std::runtime_error { "Couldn't open " + path.generic_string () };
+
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx ( file, &fileSize );
+		size = static_cast < std::size_t > ( fileSize.QuadPart );
+
+		if ( size == 0 )
+			return;
+
+		mapping = CreateFileMappingW ( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+
+		if ( mapping )
+			data = static_cast < char const * > ( MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+	#else
+		file = open ( path.c_str (), O_RDONLY );
+
+		if ( file == -1 )
+			throw std::runtime_error { "Couldn't open " + path.generic_string () };
+
+		struct stat fileStatus;
+		fstat ( file, &fileStatus );
+		size = static_cast < std::size_t > ( fileStatus.st_size );
+
+		if ( size == 0 )
+			return;
+
+		auto mapped { mmap ( nullptr, size, PROT_READ, MAP_PRIVATE, file, 0 ) };
+
+		if ( mapped != MAP_FAILED )
+		{
+			madvise ( mapped, size, MADV_SEQUENTIAL );
+			data = static_cast < char const * > ( mapped );
+		}
+	#endif
+
+		if ( ! data )
+			throw std::runtime_error { "Couldn't map " + path.generic_string () };
+	}
+
+	MappedFile::~MappedFile ()
+	{
+	#ifdef _WIN32
+		if ( data )
+			UnmapViewOfFile ( data );
+
+		if ( mapping )
+			CloseHandle ( mapping );
+
+		if ( file != INVALID_HANDLE_VALUE )
+			CloseHandle ( file );
+	#else
+		if ( data )
+			munmap ( const_cast < char * > ( data ), size );
+
+		if ( file != -1 )
+			close ( file );
+	#endif
+	}
+
+	std::string_view MappedFile::GetContents () const
+	{
+		return { data, data ? size : 0 };
+	}
+
+	void WriteFileAtomically ( std::filesystem::path const & path, std::initializer_list < std::span <std::byte const> > parts )
+	{
+		auto temporaryPath { std::filesystem::path { path } += ".tmp" };
+
+		{
+			std::ofstream file { temporaryPath, std::ios::binary | std::ios::trunc };
+
+			for ( auto part : parts )
+				file.write ( reinterpret_cast < char const * > ( part.data () ), static_cast < std::streamsize > ( part.size () ) );
+
+			if ( ! file )
+				throw std::runtime_error { "Couldn't write " + temporaryPath.generic_string () };
+		}
+
+		std::filesystem::rename ( temporaryPath, path );
+	}
+
+	void TryWriteCache ( std::string const & kind, std::filesystem::path const & path, std::function <void ()> const & write )
+	{
+		try
+		{
+			write ();
+			std::cout << "Wrote " << kind << " cache " << path.generic_string () << std::endl;
+		}
+		catch ( std::exception const & exception )
+		{
+			std::cout << "Couldn't write " << kind << " cache " << path.generic_string () << ": " << exception.what () << std::endl;
+		}
+	}
+}
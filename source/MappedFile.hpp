@@ -0,0 +1,49 @@
+#pragma once
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#endif
+
+/*
+	Read only view of a whole file, mapped into memory instead of read into a buffer, and the
+	writes the caches read back that way
+*/
+
+namespace pd
+{
+	class MappedFile
+	{
+	public:
+		MappedFile ( std::filesystem::path const & );
+		~MappedFile ();
+
+		MappedFile ( MappedFile const & ) = delete;
+		MappedFile & operator = ( MappedFile const & ) = delete;
+
+		std::string_view GetContents () const;
+
+	private:
+		char const * data { nullptr };
+		std::size_t size { 0 };
+
+	#ifdef _WIN32
+		HANDLE file { INVALID_HANDLE_VALUE };
+		HANDLE mapping { nullptr };
+	#else
+		int file { -1 };
+	#endif
+	};
+
+	// Writes the parts one after another beside the path and renames the result over it, so a failed write never
+	// leaves a file that looks whole
+	void WriteFileAtomically ( std::filesystem::path const &, std::initializer_list < std::span <std::byte const> > parts );
+
+	// Everything loads fine without its cache, the next load just builds it again, so a failed write is only logged
+	void TryWriteCache ( std::string const & kind, std::filesystem::path const &, std::function <void ()> const & write );
+}
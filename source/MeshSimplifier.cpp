@@ -0,0 +1,343 @@
+#include "MeshSimplifier.hpp"
+
+namespace pd
+{
+	namespace
+	{
+		// Sum of squared distances to a set of planes, the upper triangle of a symmetric 4x4 matrix
+		class Quadric
+		{
+		public:
+			void AddPlane ( glm::dvec3 const & normal, double distance )
+			{
+				double const plane [ 4 ] { normal.x, normal.y, normal.z, distance };
+
+				for ( int row { 0 }, element { 0 }; row < 4; ++row )
+					for ( int column { row }; column < 4; ++column, ++element )
+						elements [ element ] += plane [ row ] * plane [ column ];
+			}
+
+			double Evaluate ( glm::dvec3 const & position ) const
+			{
+				double const point [ 4 ] { position.x, position.y, position.z, 1.0 };
+				double error { 0.0 };
+
+				for ( int row { 0 }, element { 0 }; row < 4; ++row )
+					for ( int column { row }; column < 4; ++column, ++element )
+						error += ( row == column ? 1.0 : 2.0 ) * elements [ element ] * point [ row ] * point [ column ];
+
+				return error;
+			}
+
+			Quadric & operator += ( Quadric const & other )
+			{
+				for ( std::size_t element { 0 }; element < elements.size (); ++element )
+					elements [ element ] += other.elements [ element ];
+
+				return *this;
+			}
+
+		private:
+			std::array <double, 10> elements {};
+		};
+
+		// Moves a vertex onto another, both are local indices of canonical vertices
+		struct Collapse
+		{
+			double cost;
+			uint32_t from;
+			uint32_t to;
+		};
+
+		uint64_t GetEdgeKey ( uint32_t first, uint32_t second )
+		{
+			return static_cast < uint64_t > ( std::min ( first, second ) ) << 32 | std::max ( first, second );
+		}
+	}
+
+	std::vector <uint32_t> SimplifyMesh ( std::span <float const> vertices, std::size_t vertexComponents,
+		std::span <uint32_t const> indices, std::size_t targetIndexCount, float maxError )
+	{
+		// Only the vertices the mesh uses, numbered locally
+		std::vector <uint32_t> globalIndices { indices.begin (), indices.end () };
+		std::ranges::sort ( globalIndices );
+		globalIndices.erase ( std::unique ( globalIndices.begin (), globalIndices.end () ), globalIndices.end () );
+
+		auto vertexCount { globalIndices.size () };
+
+		auto getVertex { [ & ] ( uint32_t local ) {
+			return vertices.subspan ( globalIndices [ local ] * vertexComponents, vertexComponents );
+		} };
+
+		auto getPosition { [ & ] ( uint32_t local ) {
+			auto vertex { getVertex ( local ) };
+			return glm::dvec3 { vertex [ 0 ], vertex [ 1 ], vertex [ 2 ] };
+		} };
+
+		// Vertices alike in every component draw the same and become one canonical vertex.
+		// Canonical vertices sharing a position are one point of the surface, several of them make a texture seam
+		std::vector <uint32_t> canonical ( vertexCount );
+		std::vector <uint32_t> points ( vertexCount );
+
+		{
+			std::unordered_map < std::string_view, uint32_t > canonicalIndices, pointIndices;
+
+			for ( uint32_t local { 0 }; local < vertexCount; ++local )
+			{
+				auto vertex { getVertex ( local ) };
+				std::string_view bytes { reinterpret_cast < char const * > ( vertex.data () ), vertex.size_bytes () };
+
+				canonical [ local ] = canonicalIndices.try_emplace ( bytes, local ).first->second;
+				points [ local ] = pointIndices.try_emplace ( bytes.substr ( 0, 3 * sizeof ( float ) ), local ).first->second;
+			}
+		}
+
+		std::vector <uint32_t> triangles;
+		triangles.reserve ( indices.size () );
+
+		for ( std::size_t first { 0 }; first + 3 <= indices.size (); first += 3 )
+		{
+			uint32_t triangle [ 3 ];
+
+			for ( int corner { 0 }; corner < 3; ++corner )
+			{
+				auto local { std::ranges::lower_bound ( globalIndices, indices [ first + corner ] ) - globalIndices.begin () };
+				triangle [ corner ] = canonical [ local ];
+			}
+
+			if ( points [ triangle [ 0 ] ] != points [ triangle [ 1 ] ] && points [ triangle [ 1 ] ] != points [ triangle [ 2 ] ]
+				&& points [ triangle [ 2 ] ] != points [ triangle [ 0 ] ] )
+				triangles.insert ( triangles.end (), std::begin ( triangle ), std::end ( triangle ) );
+		}
+
+		// Points that never move, on texture seams, open borders and edges shared by more than two triangles
+		std::vector <bool> locked ( vertexCount, false );
+
+		{
+			constexpr auto noVertex { std::numeric_limits <uint32_t>::max () };
+			std::vector <uint32_t> pointVertices ( vertexCount, noVertex );
+
+			for ( auto vertex : triangles )
+			{
+				auto & pointVertex { pointVertices [ points [ vertex ] ] };
+
+				if ( pointVertex == noVertex )
+					pointVertex = vertex;
+				else if ( pointVertex != vertex )
+					locked [ points [ vertex ] ] = true;
+			}
+
+			std::unordered_map < uint64_t, uint32_t > edgeTriangleCounts;
+
+			for ( std::size_t first { 0 }; first < triangles.size (); first += 3 )
+				for ( int corner { 0 }; corner < 3; ++corner )
+					++edgeTriangleCounts [ GetEdgeKey ( points [ triangles [ first + corner ] ], points [ triangles [ first + ( corner + 1 ) % 3 ] ] ) ];
+
+			for ( auto const & [ edge, triangleCount ] : edgeTriangleCounts )
+			{
+				if ( triangleCount != 2 )
+				{
+					locked [ static_cast < uint32_t > ( edge >> 32 ) ] = true;
+					locked [ static_cast < uint32_t > ( edge ) ] = true;
+				}
+			}
+		}
+
+		// Every point starts with the planes of the triangles around it
+		std::vector <Quadric> quadrics ( vertexCount );
+
+		for ( std::size_t first { 0 }; first < triangles.size (); first += 3 )
+		{
+			auto position { getPosition ( triangles [ first ] ) };
+			auto normal { glm::cross ( getPosition ( triangles [ first + 1 ] ) - position, getPosition ( triangles [ first + 2 ] ) - position ) };
+			auto length { glm::length ( normal ) };
+
+			if ( length == 0.0 )
+				continue;
+
+			normal /= length;
+
+			Quadric quadric;
+			quadric.AddPlane ( normal, -glm::dot ( normal, position ) );
+
+			for ( int corner { 0 }; corner < 3; ++corner )
+				quadrics [ points [ triangles [ first + corner ] ] ] += quadric;
+		}
+
+		auto maxCost { static_cast < double > ( maxError ) * maxError };
+		auto targetTriangleCount { targetIndexCount / 3 };
+
+		// Each pass collapses the cheapest edges whose neighbourhoods don't overlap, then rebuilds the triangles
+		while ( triangles.size () / 3 > targetTriangleCount )
+		{
+			auto triangleCount { triangles.size () / 3 };
+
+			// Triangles around each point
+			std::vector <uint32_t> pointTriangleOffsets ( vertexCount + 1, 0 );
+			std::vector <uint32_t> pointTriangles ( triangles.size () );
+
+			for ( auto vertex : triangles )
+				++pointTriangleOffsets [ points [ vertex ] + 1 ];
+
+			std::partial_sum ( pointTriangleOffsets.begin (), pointTriangleOffsets.end (), pointTriangleOffsets.begin () );
+
+			{
+				auto nextSlots { pointTriangleOffsets };
+
+				for ( std::size_t index { 0 }; index < triangles.size (); ++index )
+					pointTriangles [ nextSlots [ points [ triangles [ index ] ] ]++ ] = static_cast < uint32_t > ( index / 3 );
+			}
+
+			auto getPointTriangles { [ & ] ( uint32_t point ) {
+				return std::span { pointTriangles }.subspan ( pointTriangleOffsets [ point ], pointTriangleOffsets [ point + 1 ] - pointTriangleOffsets [ point ] );
+			} };
+
+			auto containsPoint { [ & ] ( uint32_t triangle, uint32_t point ) {
+				return points [ triangles [ triangle * 3 ] ] == point || points [ triangles [ triangle * 3 + 1 ] ] == point
+					|| points [ triangles [ triangle * 3 + 2 ] ] == point;
+			} };
+
+			std::vector <Collapse> collapses;
+
+			for ( std::size_t first { 0 }; first < triangles.size (); first += 3 )
+			{
+				for ( int corner { 0 }; corner < 3; ++corner )
+				{
+					auto from { triangles [ first + corner ] };
+
+					if ( locked [ points [ from ] ] )
+						continue;
+
+					for ( int other { 1 }; other < 3; ++other )
+					{
+						auto to { triangles [ first + ( corner + other ) % 3 ] };
+
+						auto quadric { quadrics [ points [ from ] ] };
+						quadric += quadrics [ points [ to ] ];
+
+						collapses.push_back ( { quadric.Evaluate ( getPosition ( to ) ), from, to } );
+					}
+				}
+			}
+
+			std::ranges::sort ( collapses, {}, &Collapse::cost );
+
+			// Points whose triangles changed in this pass
+			std::vector <bool> touched ( vertexCount, false );
+			std::vector <uint32_t> remap ( vertexCount );
+			std::iota ( remap.begin (), remap.end (), 0 );
+
+			auto collapsed { false };
+
+			for ( auto const & collapse : collapses )
+			{
+				if ( collapse.cost > maxCost || triangleCount <= targetTriangleCount )
+					break;
+
+				auto from { points [ collapse.from ] };
+				auto to { points [ collapse.to ] };
+
+				if ( touched [ from ] || touched [ to ] )
+					continue;
+
+				// Only the triangles on the edge may lose it, any other shared neighbour would pinch the surface
+				std::vector <uint32_t> fromNeighbours, toNeighbours;
+				std::size_t edgeTriangleCount { 0 };
+
+				for ( auto [ point, neighbours ] : { std::pair { from, &fromNeighbours }, std::pair { to, &toNeighbours } } )
+				{
+					for ( auto triangle : getPointTriangles ( point ) )
+					{
+						for ( int corner { 0 }; corner < 3; ++corner )
+						{
+							auto neighbour { points [ triangles [ triangle * 3 + corner ] ] };
+
+							if ( neighbour != from && neighbour != to )
+								neighbours->push_back ( neighbour );
+						}
+					}
+
+					std::ranges::sort ( *neighbours );
+					neighbours->erase ( std::unique ( neighbours->begin (), neighbours->end () ), neighbours->end () );
+				}
+
+				for ( auto triangle : getPointTriangles ( from ) )
+					edgeTriangleCount += containsPoint ( triangle, to );
+
+				std::vector <uint32_t> sharedNeighbours;
+				std::ranges::set_intersection ( fromNeighbours, toNeighbours, std::back_inserter ( sharedNeighbours ) );
+
+				if ( sharedNeighbours.size () != edgeTriangleCount )
+					continue;
+
+				// Nor may any remaining triangle flip over
+				auto destination { getPosition ( collapse.to ) };
+				auto flips { false };
+
+				for ( auto triangle : getPointTriangles ( from ) )
+				{
+					if ( containsPoint ( triangle, to ) )
+						continue;
+
+					glm::dvec3 before [ 3 ], after [ 3 ];
+
+					for ( int corner { 0 }; corner < 3; ++corner )
+					{
+						auto vertex { triangles [ triangle * 3 + corner ] };
+						before [ corner ] = getPosition ( vertex );
+						after [ corner ] = points [ vertex ] == from ? destination : before [ corner ];
+					}
+
+					auto normalBefore { glm::cross ( before [ 1 ] - before [ 0 ], before [ 2 ] - before [ 0 ] ) };
+					auto normalAfter { glm::cross ( after [ 1 ] - after [ 0 ], after [ 2 ] - after [ 0 ] ) };
+
+					if ( glm::dot ( normalBefore, normalAfter ) <= 0.0 )
+					{
+						flips = true;
+						break;
+					}
+				}
+
+				if ( flips )
+					continue;
+
+				remap [ collapse.from ] = collapse.to;
+				quadrics [ to ] += quadrics [ from ];
+
+				for ( auto triangle : getPointTriangles ( from ) )
+					for ( int corner { 0 }; corner < 3; ++corner )
+						touched [ points [ triangles [ triangle * 3 + corner ] ] ] = true;
+
+				triangleCount -= edgeTriangleCount;
+				collapsed = true;
+			}
+
+			if ( ! collapsed )
+				break;
+
+			std::size_t kept { 0 };
+
+			for ( std::size_t first { 0 }; first < triangles.size (); first += 3 )
+			{
+				uint32_t triangle [ 3 ] { remap [ triangles [ first ] ], remap [ triangles [ first + 1 ] ], remap [ triangles [ first + 2 ] ] };
+
+				if ( points [ triangle [ 0 ] ] == points [ triangle [ 1 ] ] || points [ triangle [ 1 ] ] == points [ triangle [ 2 ] ]
+					|| points [ triangle [ 2 ] ] == points [ triangle [ 0 ] ] )
+					continue;
+
+				std::ranges::copy ( triangle, triangles.begin () + kept );
+				kept += 3;
+			}
+
+			triangles.resize ( kept );
+		}
+
+		std::vector <uint32_t> simplified;
+		simplified.reserve ( triangles.size () );
+
+		for ( auto vertex : triangles )
+			simplified.push_back ( globalIndices [ vertex ] );
+
+		return simplified;
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+	Mesh simplification by edge collapses ordered by their quadric error (Garland and Heckbert).
+	Vertices only ever collapse onto a neighbour, so the simplified triangles index the same
+	vertex buffer. Vertices on open borders and texture seams stay, so no cracks or texture
+	distortion appear where meshes or UV islands meet.
+*/
+
+namespace pd
+{
+	// Collapses edges until at most targetIndexCount indices remain or the next collapse would move the surface
+	// by more than maxError, and returns the remaining triangles. Vertices start with a position of three floats
+	std::vector <uint32_t> SimplifyMesh ( std::span <float const> vertices, std::size_t vertexComponents,
+		std::span <uint32_t const> indices, std::size_t targetIndexCount, float maxError );
+}
@@ -0,0 +1,453 @@
+#include "ObjLoader.hpp"
+#include "Core.hpp"
+#include "MappedFile.hpp"
+
+namespace pd::obj
+{
+	namespace
+	{
+		// Files are small enough below this that threads cost more than they save
+		constexpr std::size_t minChunkSize { 1024 * 1024 };
+
+		// Marks a face corner without a texture coordinate or normal
+		constexpr int missingIndex { std::numeric_limits <int>::min () };
+
+		struct Corner
+		{
+			// Position, texture coordinates, normal
+			int indices [ 3 ];
+
+			// Bit per index that counts back from the end of its chunk's list instead of the file's
+			uint8_t relativeMask;
+		};
+
+		struct Face
+		{
+			uint32_t firstCorner;
+			uint32_t cornerCount;
+		};
+
+		// Statements that apply to every face after them
+		struct Statement
+		{
+			enum class Type { object, useMaterial, materialLibrary };
+
+			Type type;
+			std::string argument;
+
+			// Number of faces in the chunk before the statement
+			std::size_t face;
+		};
+
+		struct Chunk
+		{
+			std::vector <glm::vec3> positions;
+			std::vector <glm::vec2> textureCoordinates;
+			std::vector <glm::vec3> normals;
+
+			std::vector <Corner> corners;
+			std::vector <Face> faces;
+			std::vector <Statement> statements;
+		};
+
+		struct VertexKey
+		{
+			int position;
+			int textureCoordinates;
+			int normal;
+
+			bool operator == ( VertexKey const & ) const = default;
+		};
+
+		struct VertexKeyHash
+		{
+			std::size_t operator () ( VertexKey const & key ) const
+			{
+				auto hash { static_cast < std::size_t > ( key.position ) * 73856093 };
+				hash ^= static_cast < std::size_t > ( key.textureCoordinates ) * 19349663;
+				hash ^= static_cast < std::size_t > ( key.normal ) * 83492791;
+				return hash;
+			}
+		};
+
+		bool IsSpace ( char character )
+		{
+			return character == ' ' || character == '\t' || character == '\r';
+		}
+
+		// Takes the next line off the front of the text, without its line break
+		std::string_view NextLine ( std::string_view & text )
+		{
+			auto end { text.find ( '\n' ) };
+			auto line { text.substr ( 0, end ) };
+
+			text.remove_prefix ( end == std::string_view::npos ? text.size () : end + 1 );
+
+			return line;
+		}
+
+		// Takes the next whitespace separated token off the front of the line
+		std::string_view NextToken ( std::string_view & line )
+		{
+			while ( ! line.empty () && IsSpace ( line.front () ) )
+				line.remove_prefix ( 1 );
+
+			std::size_t length { 0 };
+
+			while ( length < line.size () && ! IsSpace ( line [ length ] ) )
+				++length;
+
+			auto token { line.substr ( 0, length ) };
+			line.remove_prefix ( length );
+
+			return token;
+		}
+
+		// The rest of the line with surrounding whitespace removed
+		std::string_view Trim ( std::string_view text )
+		{
+			while ( ! text.empty () && IsSpace ( text.front () ) )
+				text.remove_prefix ( 1 );
+
+			while ( ! text.empty () && IsSpace ( text.back () ) )
+				text.remove_suffix ( 1 );
+
+			return text;
+		}
+
+		float ParseFloat ( std::string_view & line )
+		{
+			auto token { NextToken ( line ) };
+
+			// from_chars doesn't take an explicit plus sign
+			if ( ! token.empty () && token.front () == '+' )
+				token.remove_prefix ( 1 );
+
+			float value { 0.0f };
+			std::from_chars ( token.data (), token.data () + token.size (), value );
+
+			return value;
+		}
+
+		glm::vec3 ParseVec3 ( std::string_view & line )
+		{
+			auto x { ParseFloat ( line ) };
+			auto y { ParseFloat ( line ) };
+			auto z { ParseFloat ( line ) };
+			return { x, y, z };
+		}
+
+		// Parses a v/vt/vn corner, resolving indices against the counts read so far in the chunk
+		Corner ParseCorner ( std::string_view token, Chunk const & chunk )
+		{
+			Corner corner { { missingIndex, missingIndex, missingIndex }, 0 };
+
+			std::size_t const counts [ 3 ] { chunk.positions.size (), chunk.textureCoordinates.size (), chunk.normals.size () };
+
+			for ( int component { 0 }; component < 3 && ! token.empty (); ++component )
+			{
+				auto end { token.find ( '/' ) };
+				auto number { token.substr ( 0, end ) };
+
+				token.remove_prefix ( end == std::string_view::npos ? token.size () : end + 1 );
+
+				if ( number.empty () )
+					continue;
+
+				int index { 0 };
+				std::from_chars ( number.data (), number.data () + number.size (), index );
+
+				if ( index > 0 )
+				{
+					corner.indices [ component ] = index - 1;
+				}
+				else if ( index < 0 )
+				{
+					// May count back past the start of the chunk, into the ones before it
+					corner.indices [ component ] = static_cast < int > ( counts [ component ] ) + index;
+					corner.relativeMask |= 1 << component;
+				}
+			}
+
+			return corner;
+		}
+
+		Chunk ParseChunk ( std::string_view text )
+		{
+			Chunk chunk;
+
+			while ( ! text.empty () )
+			{
+				auto line { NextLine ( text ) };
+				auto keyword { NextToken ( line ) };
+
+				if ( keyword.empty () || keyword.front () == '#' )
+					continue;
+
+				if ( keyword == "v" )
+				{
+					chunk.positions.push_back ( ParseVec3 ( line ) );
+				}
+				else if ( keyword == "vt" )
+				{
+					auto u { ParseFloat ( line ) };
+					auto v { ParseFloat ( line ) };
+					chunk.textureCoordinates.push_back ( { u, v } );
+				}
+				else if ( keyword == "vn" )
+				{
+					chunk.normals.push_back ( ParseVec3 ( line ) );
+				}
+				else if ( keyword == "f" )
+				{
+					Face face { static_cast < uint32_t > ( chunk.corners.size () ), 0 };
+
+					for ( auto token { NextToken ( line ) }; ! token.empty (); token = NextToken ( line ) )
+					{
+						chunk.corners.push_back ( ParseCorner ( token, chunk ) );
+						++face.cornerCount;
+					}
+
+					if ( face.cornerCount >= 3 )
+						chunk.faces.push_back ( face );
+					else
+						chunk.corners.resize ( face.firstCorner );
+				}
+				else if ( keyword == "o" || keyword == "g" )
+				{
+					auto name { Trim ( line ) };
+					chunk.statements.push_back ( { Statement::Type::object, std::string { name.empty () ? "unnamed" : name }, chunk.faces.size () } );
+				}
+				else if ( keyword == "usemtl" )
+				{
+					chunk.statements.push_back ( { Statement::Type::useMaterial, std::string { Trim ( line ) }, chunk.faces.size () } );
+				}
+				else if ( keyword == "mtllib" )
+				{
+					chunk.statements.push_back ( { Statement::Type::materialLibrary, std::string { Trim ( line ) }, chunk.faces.size () } );
+				}
+			}
+
+			return chunk;
+		}
+
+		void LoadMaterials ( std::filesystem::path const & path, std::vector <Material> & materials )
+		{
+			MappedFile file { path };
+			auto text { file.GetContents () };
+
+			auto directory { path.parent_path () };
+			Material * material { nullptr };
+
+			while ( ! text.empty () )
+			{
+				auto line { NextLine ( text ) };
+				auto keyword { NextToken ( line ) };
+
+				if ( keyword == "newmtl" )
+				{
+					material = &materials.emplace_back ();
+					material->name = Trim ( line );
+				}
+
+				if ( ! material )
+					continue;
+
+				if ( keyword == "Ka" )
+					material->ambientColor = ParseVec3 ( line );
+				else if ( keyword == "Kd" )
+					material->diffuseColor = ParseVec3 ( line );
+				else if ( keyword == "Ks" )
+					material->specularColor = ParseVec3 ( line );
+				else if ( keyword == "map_Ka" )
+					material->ambientMap = ( directory / Trim ( line ) ).generic_string ();
+				else if ( keyword == "map_Kd" )
+					material->diffuseMap = ( directory / Trim ( line ) ).generic_string ();
+				else if ( keyword == "map_Ks" )
+					material->specularMap = ( directory / Trim ( line ) ).generic_string ();
+			}
+		}
+
+		// Splits at line breaks into roughly equal chunks, one per thread
+		std::vector <std::string_view> SplitIntoChunks ( std::string_view text )
+		{
+			auto chunkCount { std::clamp <std::size_t> ( text.size () / minChunkSize, 1, std::max ( 1u, std::thread::hardware_concurrency () ) ) };
+
+			std::vector <std::string_view> chunks;
+			std::size_t begin { 0 };
+
+			for ( std::size_t chunk { 1 }; chunk <= chunkCount && begin < text.size (); ++chunk )
+			{
+				auto end { chunk == chunkCount ? text.size () : text.find ( '\n', text.size () * chunk / chunkCount ) };
+				end = end == std::string_view::npos ? text.size () : std::max ( end + 1, begin );
+
+				chunks.push_back ( text.substr ( begin, end - begin ) );
+				begin = end;
+			}
+
+			return chunks;
+		}
+	}
+
+	Scene Load ( std::filesystem::path const & path )
+	{
+		MappedFile file { path };
+
+		auto chunkTexts { SplitIntoChunks ( file.GetContents () ) };
+		std::vector <Chunk> chunks ( chunkTexts.size () );
+
+		ParallelFor ( chunks.size (), [ & ] ( std::size_t chunk ) {
+			chunks [ chunk ] = ParseChunk ( chunkTexts [ chunk ] );
+		} );
+
+		// Join the chunks' attribute lists, remembering where each chunk's start
+		std::vector <glm::vec3> positions;
+		std::vector <glm::vec2> textureCoordinates;
+		std::vector <glm::vec3> normals;
+
+		std::vector < std::array < int, 3 > > chunkOffsets;
+		std::size_t cornerCount { 0 };
+
+		for ( auto const & chunk : chunks )
+		{
+			chunkOffsets.push_back ( {
+				static_cast < int > ( positions.size () ),
+				static_cast < int > ( textureCoordinates.size () ),
+				static_cast < int > ( normals.size () )
+			} );
+
+			positions.insert ( positions.end (), chunk.positions.begin (), chunk.positions.end () );
+			textureCoordinates.insert ( textureCoordinates.end (), chunk.textureCoordinates.begin (), chunk.textureCoordinates.end () );
+			normals.insert ( normals.end (), chunk.normals.begin (), chunk.normals.end () );
+
+			cornerCount += chunk.corners.size ();
+		}
+
+		Scene scene;
+		scene.indices.reserve ( cornerCount * 2 );
+
+		std::unordered_map < VertexKey, uint32_t, VertexKeyHash > vertexIndices;
+		vertexIndices.reserve ( cornerCount );
+
+		std::unordered_map < std::string, int > materialIndices;
+
+		std::string meshName { "unnamed" };
+		int meshMaterial { -1 };
+		std::size_t meshIndexOffset { 0 };
+
+		auto finishMesh { [ & ] () {
+			if ( scene.indices.size () > meshIndexOffset )
+			{
+				scene.meshes.push_back ( {
+					meshName,
+					static_cast < uint32_t > ( meshIndexOffset ),
+					static_cast < uint32_t > ( scene.indices.size () - meshIndexOffset ),
+					meshMaterial
+				} );
+			}
+
+			meshIndexOffset = scene.indices.size ();
+		} };
+
+		auto apply { [ & ] ( Statement const & statement ) {
+			switch ( statement.type )
+			{
+			case Statement::Type::object:
+				finishMesh ();
+				meshName = statement.argument;
+				break;
+
+			case Statement::Type::useMaterial:
+			{
+				finishMesh ();
+				auto materialIt { materialIndices.find ( statement.argument ) };
+				meshMaterial = materialIt == materialIndices.end () ? -1 : materialIt->second;
+				break;
+			}
+
+			case Statement::Type::materialLibrary:
+				scene.materialLibraries.push_back ( path.parent_path () / statement.argument );
+				LoadMaterials ( scene.materialLibraries.back (), scene.materials );
+
+				for ( int index { 0 }; index < static_cast < int > ( scene.materials.size () ); ++index )
+					materialIndices.try_emplace ( scene.materials [ index ].name, index );
+
+				break;
+			}
+		} };
+
+		auto resolveVertex { [ & ] ( Corner const & corner, std::array < int, 3 > const & offsets ) {
+			std::size_t const counts [ 3 ] { positions.size (), textureCoordinates.size (), normals.size () };
+			int indices [ 3 ];
+
+			for ( int component { 0 }; component < 3; ++component )
+			{
+				indices [ component ] = corner.indices [ component ];
+
+				if ( indices [ component ] == missingIndex )
+				{
+					indices [ component ] = -1;
+					continue;
+				}
+
+				if ( corner.relativeMask & ( 1 << component ) )
+					indices [ component ] += offsets [ component ];
+
+				if ( indices [ component ] < 0 || indices [ component ] >= static_cast < int > ( counts [ component ] ) )
+					throw std::runtime_error { "Face in " + path.generic_string () + " references a missing vertex" };
+			}
+
+			VertexKey key { indices [ 0 ], indices [ 1 ], indices [ 2 ] };
+			auto [ vertexIt, inserted ] { vertexIndices.try_emplace ( key, static_cast < uint32_t > ( scene.vertices.size () ) ) };
+
+			if ( inserted )
+			{
+				scene.vertices.push_back ( {
+					positions [ key.position ],
+					key.textureCoordinates == -1 ? glm::vec2 {} : textureCoordinates [ key.textureCoordinates ],
+					key.normal == -1 ? glm::vec3 {} : normals [ key.normal ]
+				} );
+			}
+
+			return vertexIt->second;
+		} };
+
+		// Statements and faces are replayed in file order, the chunks only ever split between lines
+		for ( std::size_t chunkIndex { 0 }; chunkIndex < chunks.size (); ++chunkIndex )
+		{
+			auto const & chunk { chunks [ chunkIndex ] };
+			auto statementIt { chunk.statements.begin () };
+
+			for ( std::size_t faceIndex { 0 }; faceIndex < chunk.faces.size (); ++faceIndex )
+			{
+				for ( ; statementIt != chunk.statements.end () && statementIt->face == faceIndex; ++statementIt )
+					apply ( *statementIt );
+
+				auto const & face { chunk.faces [ faceIndex ] };
+				auto const * corners { chunk.corners.data () + face.firstCorner };
+
+				// Fan triangulation, polygons in OBJ files are expected to be convex
+				auto first { resolveVertex ( corners [ 0 ], chunkOffsets [ chunkIndex ] ) };
+				auto previous { resolveVertex ( corners [ 1 ], chunkOffsets [ chunkIndex ] ) };
+
+				for ( uint32_t corner { 2 }; corner < face.cornerCount; ++corner )
+				{
+					auto current { resolveVertex ( corners [ corner ], chunkOffsets [ chunkIndex ] ) };
+
+					scene.indices.push_back ( first );
+					scene.indices.push_back ( previous );
+					scene.indices.push_back ( current );
+
+					previous = current;
+				}
+			}
+
+			for ( ; statementIt != chunk.statements.end (); ++statementIt )
+				apply ( *statementIt );
+		}
+
+		finishMesh ();
+
+		return scene;
+	}
+}
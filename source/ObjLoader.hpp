@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+	Wavefront OBJ and MTL reader. The file is memory mapped and split into chunks
+	that are parsed on separate threads, then stitched together in file order.
+	Face corners sharing a position, texture coordinate and normal become one vertex.
+*/
+
+namespace pd::obj
+{
+	struct Material
+	{
+		std::string name;
+
+		glm::vec3 ambientColor {};
+		glm::vec3 diffuseColor {};
+		glm::vec3 specularColor {};
+
+		// Already resolved against the material file's directory
+		std::string ambientMap;
+		std::string diffuseMap;
+		std::string specularMap;
+	};
+
+	struct Vertex
+	{
+		glm::vec3 position {};
+		glm::vec2 textureCoordinates {};
+		glm::vec3 normal {};
+	};
+
+	// A run of faces sharing an object or group and a material
+	struct Mesh
+	{
+		std::string name;
+
+		uint32_t indexOffset;
+		uint32_t indexCount;
+
+		// Index into Scene::materials, -1 if the faces have none
+		int material;
+	};
+
+	struct Scene
+	{
+		std::vector <Vertex> vertices;
+		std::vector <uint32_t> indices;
+		std::vector <Mesh> meshes;
+		std::vector <Material> materials;
+
+		// Files the materials were read from
+		std::vector <std::filesystem::path> materialLibraries;
+	};
+
+	Scene Load ( std::filesystem::path const & );
+}
@@ -1,11 +1,27 @@
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
 #include <cassert>
 #include <unordered_map>
+#include <map>
+#include <mutex>
 #include <functional>
+#include <optional>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <string_view>
+#include <span>
+#include <bit>
+#include <numeric>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
@@ -0,0 +1,134 @@
+#include "PipelineCache.hpp"
+#include "MappedFile.hpp"
+
+namespace pd
+{
+	namespace
+	{
+		// Bump whenever the file layout changes
+		constexpr uint32_t fileVersion { 1 };
+		constexpr char fileMagic [ 4 ] { 'P', 'D', 'P', 'C' };
+
+		// Followed by the driver's data. Every field is four byte aligned, so there is no padding to compare
+		struct Header
+		{
+			char magic [ 4 ];
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint8_t deviceUUID [ VK_UUID_SIZE ];
+			uint8_t pipelineCacheUUID [ VK_UUID_SIZE ];
+			uint32_t dataSize;
+		};
+
+		Header GetHeader ( vk::PhysicalDevice physicalDevice, uint32_t dataSize )
+		{
+			auto properties { physicalDevice.getProperties2 <vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties> () };
+			auto const & deviceProperties { properties.get <vk::PhysicalDeviceProperties2> ().properties };
+			auto const & idProperties { properties.get <vk::PhysicalDeviceIDProperties> () };
+
+			Header header;
+			std::memcpy ( header.magic, fileMagic, sizeof ( fileMagic ) );
+			header.version = fileVersion;
+			header.vendorID = deviceProperties.vendorID;
+			header.deviceID = deviceProperties.deviceID;
+			header.driverVersion = deviceProperties.driverVersion;
+			std::memcpy ( header.deviceUUID, idProperties.deviceUUID.data (), VK_UUID_SIZE );
+			std::memcpy ( header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID.data (), VK_UUID_SIZE );
+			header.dataSize = dataSize;
+
+			return header;
+		}
+
+		// Empty when the file is missing or was written with another device or driver
+		std::string ReadCacheData ( std::filesystem::path const & filePath, vk::PhysicalDevice physicalDevice )
+		{
+			if ( ! std::filesystem::exists ( filePath ) )
+				return {};
+
+			MappedFile file { filePath };
+			auto contents { file.GetContents () };
+
+			if ( contents.size () < sizeof ( Header ) )
+				return {};
+
+			auto expected { GetHeader ( physicalDevice, static_cast < uint32_t > ( contents.size () - sizeof ( Header ) ) ) };
+
+			if ( std::memcmp ( contents.data (), &expected, sizeof ( Header ) ) != 0 )
+				return {};
+
+			return std::string { contents.substr ( sizeof ( Header ) ) };
+		}
+
+		void WriteCacheData ( std::filesystem::path const & filePath, vk::PhysicalDevice physicalDevice, std::vector <uint8_t> const & data )
+		{
+			auto header { GetHeader ( physicalDevice, static_cast < uint32_t > ( data.size () ) ) };
+
+			WriteFileAtomically ( filePath, { std::as_bytes ( std::span { &header, 1 } ), std::as_bytes ( std::span { data } ) } );
+		}
+	}
+
+	void PipelineCache::Initialize ( Dependencies const & deps, std::filesystem::path const & filePath )
+	{
+		this->deps = deps;
+		this->filePath = filePath;
+
+		std::string data;
+
+		try
+		{
+			data = ReadCacheData ( filePath, deps.physicalDevice );
+		}
+		catch ( std::exception const & exception )
+		{
+			std::cout << "Ignoring pipeline cache " << filePath.generic_string () << ": " << exception.what () << std::endl;
+		}
+
+		if ( ! data.empty () )
+			std::cout << "Using pipeline cache " << filePath.generic_string () << std::endl;
+
+		// The driver still checks the data itself and starts empty if it disagrees
+		cache = deps.device.createPipelineCache ( { {}, data.size (), data.data () } );
+	}
+
+	void PipelineCache::Shutdown ()
+	{
+		TryWriteCache ( "pipeline", filePath, [ this ] () {
+			WriteCacheData ( filePath, deps.physicalDevice, deps.device.getPipelineCacheData ( cache ) );
+		} );
+
+		deps.device.destroy ( cache );
+	}
+
+	void PipelineCache::Compile ( vk::Pipeline & pipeline, std::function <vk::Pipeline ()> create )
+	{
+		// The cache is internally synchronized, compiles share it freely
+		compiles.push_back ( std::async ( std::launch::async, [ &pipeline, create = std::move ( create ) ] () {
+			pipeline = create ();
+		} ) );
+	}
+
+	void PipelineCache::WaitForCompiles ()
+	{
+		std::exception_ptr exception;
+
+		for ( auto & compile : compiles )
+		{
+			try
+			{
+				compile.get ();
+			}
+			catch ( ... )
+			{
+				if ( ! exception )
+					exception = std::current_exception ();
+			}
+		}
+
+		compiles.clear ();
+
+		if ( exception )
+			std::rethrow_exception ( exception );
+	}
+}
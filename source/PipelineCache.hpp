@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Core.hpp"
+
+/*
+	The driver's pipeline cache, kept in a file between runs so warm starts skip shader compilation.
+	The file records the device, driver version and cache UUID it was written with and is ignored on
+	any other, so a driver is never handed data from another device or build of itself.
+	Subsystems queue their pipelines during initialization, they compile on worker threads meanwhile
+	and are waited on together before the first frame.
+*/
+
+namespace pd
+{
+	class PipelineCache
+	{
+	public:
+		struct Dependencies
+		{
+			vk::PhysicalDevice physicalDevice;
+			vk::Device device;
+		};
+
+		void Initialize ( Dependencies const &, std::filesystem::path const & filePath );
+
+		// Writes the cache back to its file, every compile must have been waited on
+		void Shutdown ();
+
+		// Runs the creation on a worker thread, the pipeline is written by the time WaitForCompiles returns
+		void Compile ( vk::Pipeline &, std::function <vk::Pipeline ()> create );
+
+		// Rethrows the first exception a compile threw, once all of them have finished
+		void WaitForCompiles ();
+
+		vk::PipelineCache Get () const;
+
+	private:
+		Dependencies deps;
+		std::filesystem::path filePath;
+		vk::PipelineCache cache;
+
+		std::vector < std::future <void> > compiles;
+	};
+
+
+
+	// Implementation
+	inline vk::PipelineCache PipelineCache::Get () const { return cache; }
+}
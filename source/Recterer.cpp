@@ -1,4 +1,5 @@
 #include "Recterer.hpp"
+#include "Shaders.hpp"
 
 namespace pd
 {
@@ -11,126 +12,162 @@ namespace pd
 
 		globalDescriptorSetLayout = CreateDescriptorSetLayout ( deps.device, {}, { 
 			// Camera
-			{ 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+			{ 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex },
 			// Instance transforms array
-			{ 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+			{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
 			// Instance color array
-			{ 2, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
-		} );
-
-		batchDescriptorSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
-			// Texture sampler
-			{ 0, vk::DescriptorType::eSampler, 1, vk::ShaderStageFlagBits::eFragment, &sampler },
-			// Texture
-			{ 1, vk::DescriptorType::eSampledImage, 1, vk::ShaderStageFlagBits::eFragment },
+			{ 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment },
 			// Instance index array
-			{ 2, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
-		} );
-
-		globalDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, globalDescriptorSetLayout );
+			{ 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+			// Texture sampler
+			{ 4, vk::DescriptorType::eSampler, 1, vk::ShaderStageFlagBits::eFragment, &sampler },
+			// Texture table, only the entries in use are written
+			{ 5, vk::DescriptorType::eSampledImage, maxTextures, vk::ShaderStageFlagBits::eFragment },
+		}, { {}, {}, {}, {}, {}, vk::DescriptorBindingFlagBits::ePartiallyBound } );
 		
 		pipelineLayout = CreatePipelineLayout ();
-		pipeline = CreatePipeline ();
 
-		rectangleIDManager = { 0, maxInstances - 1 };
+		for ( int variant { 0 }; variant < variantCount; ++variant )
+			deps.pipelineCache->Compile ( pipelines [ variant ], [ this, variant ] () { return CreatePipeline ( variant ); } );
 
 		CreateGeometryBuffers ();
 		
 		// Create camera buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, BufferUsages::uniformBuffer, sizeof ( CameraData ),
-			cameraUniformBuffer, cameraUniformBufferMemory );
+		cameraUniformBufferStride = GetUniformBufferStride ( deps.physicalDevice, sizeof ( CameraData ) );
 
-		// Create instance transforms buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, BufferUsages::uniformBuffer, sizeof ( InstanceTransformsData ),
-			instanceTransformsBuffer, instanceTransformsBufferMemory );
+		cameraUniformBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Recterer", BufferUsages::uniformBuffer,
+			cameraUniformBufferStride * deps.framesInFlight, cameraUniformBuffer, cameraUniformBufferAllocation ) );
 
-		// Create instance colors buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, BufferUsages::uniformBuffer, 
-			sizeof ( InstanceFragmentShaderData ) * maxInstances, instanceColorsBuffer, instanceColorsBufferMemory );
+		frameInstanceBuffers.resize ( deps.framesInFlight );
 
+		for ( auto & frame : frameInstanceBuffers )
 		{
-			vk::DescriptorBufferInfo instanceTransformsBufferInfo { instanceTransformsBuffer, 0, sizeof ( glm::mat4 ) * maxInstances };
-			vk::DescriptorBufferInfo instanceColorsBufferInfo { instanceColorsBuffer, 0, sizeof ( glm::vec4 ) * maxInstances };
+			frame.globalDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, globalDescriptorSetLayout );
 
-			std::vector <vk::WriteDescriptorSet> writes {
-				{ globalDescriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &instanceTransformsBufferInfo },
-				{ globalDescriptorSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &instanceColorsBufferInfo }
-			};
+			vk::DescriptorBufferInfo bufferInfo { cameraUniformBuffer, 0, sizeof ( CameraData ) };
+			vk::WriteDescriptorSet write { frame.globalDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &bufferInfo };
+			deps.device.updateDescriptorSets ( { write }, {} );
 
-			deps.device.updateDescriptorSets ( writes, {} );
+			GrowFrameInstanceBuffers ( frame, initialInstanceCapacity );
 		}
 
+		textureViews.resize ( maxTextures );
+
 		SetViewportSize ( { 1280, 720 } );
 	}
 
 	void Recterer::Shutdown ()
 	{
-		for ( auto const & [texture, batch] : batches )
-			DeleteBatch ( batch );
+		for ( auto const & [ id, texture ] : rectangleTextures )
+			deps.textureCache->Release ( texture );
+
+		textureTable.clear ();
+		rectangleTextures.clear ();
 
-		deps.device.free ( descriptorPool, globalDescriptorSet );
+		for ( auto & frame : frameInstanceBuffers )
+		{
+			DestroyFrameInstanceBuffers ( frame );
+			deps.device.free ( descriptorPool, frame.globalDescriptorSet );
+		}
+
+		frameInstanceBuffers.clear ();
 
 		deps.device.destroy ( globalDescriptorSetLayout );
-		deps.device.destroy ( batchDescriptorSetLayout );
 		
-		deps.device.destroy ( cameraUniformBuffer );
-		deps.device.free ( cameraUniformBufferMemory );
+		DestroyBuffer ( deps.allocator, cameraUniformBuffer, cameraUniformBufferAllocation );
 		
-		deps.device.destroy ( vertexBuffer );
-		deps.device.free ( vertexBufferMemory );
+		DestroyBuffer ( deps.allocator, vertexBuffer, vertexBufferAllocation );
 
-		deps.device.destroy ( indexBuffer );
-		deps.device.free ( indexBufferMemory );
+		DestroyBuffer ( deps.allocator, indexBuffer, indexBufferAllocation );
 		
-		deps.device.destroy ( instanceTransformsBuffer );
-		deps.device.free ( instanceTransformsBufferMemory );
-
-		deps.device.destroy ( instanceColorsBuffer );
-		deps.device.free ( instanceColorsBufferMemory );
+		for ( auto pipeline : pipelines )
+			deps.device.destroy ( pipeline );
 
-		deps.device.destroy ( pipeline );
 		deps.device.destroy ( pipelineLayout );
 
 		deps.device.destroy ( sampler );
 		deps.device.destroy ( descriptorPool );
 	}
 
-	void Recterer::RecordRender ( vk::CommandBuffer commandBuffer, vk::Extent2D viewportExtent )
+	void Recterer::RecordRender ( vk::CommandBuffer commandBuffer, vk::Extent2D viewportExtent, uint32_t frameIndex )
 	{
-		commandBuffer.bindPipeline ( vk::PipelineBindPoint::eGraphics, pipeline );
+		// The GPU is done with this frame's copy, the caller waited for its fence
+		auto cameraOffset { cameraUniformBufferStride * frameIndex };
+		std::memcpy ( cameraUniformBufferData + cameraOffset, &cameraData, sizeof ( CameraData ) );
+		vmaFlushAllocation ( deps.allocator, cameraUniformBufferAllocation, cameraOffset, sizeof ( CameraData ) );
+
+		auto & frame { frameInstanceBuffers [ frameIndex ] };
+		auto instanceCount { static_cast < int > ( instanceIndices.size () ) };
+
+		if ( frame.capacity < rectangleIDManager.GetUpperBound () )
+			GrowFrameInstanceBuffers ( frame, std::max ( rectangleIDManager.GetUpperBound (), frame.capacity * 2 ) );
+
+		WriteDirtyRange ( frame.dirtyTransforms, instanceTransforms.data (), sizeof ( glm::mat4 ),
+			frame.transformsBufferAllocation, frame.transformsBufferData );
+
+		WriteDirtyRange ( frame.dirtyFragmentDatas, instanceFragmentDatas.data (), sizeof ( InstanceFragmentShaderData ),
+			frame.fragmentDatasBufferAllocation, frame.fragmentDatasBufferData );
+
+		// Slots past the end were removed since, nothing draws them
+		frame.dirtyInstanceIndices.end = std::min ( frame.dirtyInstanceIndices.end, instanceCount );
+
+		WriteDirtyRange ( frame.dirtyInstanceIndices, instanceIndices.data (), sizeof ( uint32_t ),
+			frame.instanceIndexBufferAllocation, frame.instanceIndexBufferData );
+
+		WritePendingTextures ( frame );
+
+		if ( instanceCount == 0 )
+			return;
 
 		pd::SetViewport ( commandBuffer, viewportExtent );
 
 		commandBuffer.bindVertexBuffers ( 0, { vertexBuffer }, { 0 } );
 		commandBuffer.bindIndexBuffer ( indexBuffer, 0, vk::IndexType::eUint32 );
 
-		commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { globalDescriptorSet }, {} );
+		commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { frame.globalDescriptorSet }, {
+			static_cast < uint32_t > ( cameraOffset )
+		} );
 		
-		for ( auto const & [ texture, batch ] : batches )
+		// Every rectangle picks its own texture from the table, so each variant's group of slots is one draw
+		for ( int variant { 0 }, begin { 0 }; variant < variantCount; begin = variantEnds [ variant++ ] )
 		{
-			commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, { batch.descriptorSet }, {} );
-			commandBuffer.drawIndexed ( 6, batch.instanceIndices.size (), 0, 0, 0 );
+			if ( variantEnds [ variant ] == begin )
+				continue;
+
+			commandBuffer.bindPipeline ( vk::PipelineBindPoint::eGraphics, pipelines [ variant ] );
+			commandBuffer.drawIndexed ( 6, static_cast < uint32_t > ( variantEnds [ variant ] - begin ), 0, 0, static_cast < uint32_t > ( begin ) );
 		}
 	}
 	
 	void Recterer::SetViewportSize ( glm::vec2 const & size )
 	{
-		CameraData cameraData { glm::ortho ( 0.0f, size.x, size.y, 0.0f, -100.0f, 100.0f ) };
-
-		UpdateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool,
-			deps.queues->transferQueue, cameraUniformBuffer, &cameraData, sizeof ( CameraData ) );
-
-		vk::DescriptorBufferInfo bufferInfo { cameraUniformBuffer, 0, sizeof ( CameraData ) };
-		vk::WriteDescriptorSet write { globalDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &bufferInfo };
-		deps.device.updateDescriptorSets ( { write }, {} );
+		cameraData = { glm::ortho ( 0.0f, size.x, size.y, 0.0f, -100.0f, 100.0f ) };
 	}
 
 	int Recterer::CreateRectangle ()
 	{
 		auto id { rectangleIDManager.GetID () };
+
+		if ( id >= static_cast < int > ( instanceTransforms.size () ) )
+		{
+			instanceTransforms.resize ( id + 1 );
+			instanceFragmentDatas.resize ( id + 1 );
+			instanceVariants.resize ( id + 1 );
+		}
+
+		auto slot { static_cast < int > ( instanceIndices.size () ) };
+
+		// Joins the last group, the setters below move it to its own
+		instanceIndices.push_back ( static_cast < uint32_t > ( id ) );
+		instanceSlots [ id ] = slot;
+		instanceVariants [ id ] = variantCount - 1;
+		++variantEnds [ variantCount - 1 ];
+
+		for ( auto & frame : frameInstanceBuffers )
+			frame.dirtyInstanceIndices.Add ( slot );
 		
 		// Initialize to default state
-		SetRectangleTexture ( id, "image/White.png");
+		SetRectangleTexture ( id, defaultTexture );
 		SetRectangleColor ( id, { 1, 1, 1, 1 } );
 		SetRectangleTransform ( id, glm::scale ( glm::identity <glm::mat4> (), { 100, 100, 1 } ) );
 		SetRectangleBorderSizes ( id, 0.02f, 0.02f, 0.02f, 0.02f );
@@ -142,146 +179,266 @@ namespace pd
 	void Recterer::DeleteRectangle ( int id )
 	{
 		rectangleIDManager.FreeID ( id );
-		RemoveRectangleFromBatch ( id );
+
+		ReleaseTexture ( rectangleTextures.at ( id ) );
+		rectangleTextures.erase ( id );
+
+		// Into the last group first, whose last slot is then the one freed
+		SetInstanceVariant ( id, variantCount - 1 );
+		--variantEnds [ variantCount - 1 ];
+
+		// Move the last instance into the freed slot, draw order doesn't matter with depth testing
+		auto slot { instanceSlots.at ( id ) };
+		auto lastId { static_cast < int > ( instanceIndices.back () ) };
+
+		instanceIndices [ slot ] = instanceIndices.back ();
+		instanceIndices.pop_back ();
+
+		instanceSlots [ lastId ] = slot;
+		instanceSlots.erase ( id );
+
+		if ( slot < static_cast < int > ( instanceIndices.size () ) )
+		{
+			for ( auto & frame : frameInstanceBuffers )
+				frame.dirtyInstanceIndices.Add ( slot );
+		}
 	}
 
 	void Recterer::SetRectangleTransform ( int id, glm::mat4 const & transform )
 	{
-		UpdateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue,
-			instanceTransformsBuffer, glm::value_ptr ( transform ), sizeof ( glm::mat4 ), id * sizeof ( glm::mat4 ) );
+		instanceTransforms [ id ] = transform;
+
+		for ( auto & frame : frameInstanceBuffers )
+			frame.dirtyTransforms.Add ( id );
 	}
 
 	void Recterer::SetRectangleColor ( int id, glm::vec4 const & color )
 	{
-		UpdateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue,
-			instanceColorsBuffer, glm::value_ptr ( color ), sizeof ( glm::vec4 ), id * sizeof ( InstanceFragmentShaderData ) + 0 );
+		instanceFragmentDatas [ id ].color = color;
+
+		for ( auto & frame : frameInstanceBuffers )
+			frame.dirtyFragmentDatas.Add ( id );
 	}
 	
 	void Recterer::SetRectangleBorderSizes ( int id, float left, float right, float bottom, float top )
 	{
-		glm::vec4 sizes { left, right, bottom, top };
+		instanceFragmentDatas [ id ].borderSizes = { left, right, bottom, top };
 
-		UpdateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue,
-			instanceColorsBuffer, glm::value_ptr ( sizes ), 
-			sizeof ( glm::vec4 ), id * sizeof ( InstanceFragmentShaderData ) + ( sizeof ( glm::vec4 ) * 2 ) );
+		for ( auto & frame : frameInstanceBuffers )
+			frame.dirtyFragmentDatas.Add ( id );
+
+		bool bordered { left > 0.0f || right > 0.0f || bottom > 0.0f || top > 0.0f };
+		SetInstanceVariant ( id, ( instanceVariants [ id ] & ~borderedVariant ) | ( bordered ? borderedVariant : 0 ) );
 	}
 
 	void Recterer::SetRectangleBorderColor ( int id, glm::vec4 const & color )
 	{
-		UpdateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue,
-			instanceColorsBuffer, glm::value_ptr ( color ),
-			sizeof ( glm::vec4 ), id * sizeof ( InstanceFragmentShaderData ) + sizeof ( glm::vec4 ) );
+		instanceFragmentDatas [ id ].borderColor = color;
+
+		for ( auto & frame : frameInstanceBuffers )
+			frame.dirtyFragmentDatas.Add ( id );
 	}
 
 	void Recterer::SetRectangleTexture ( int id, std::string const & texture )
 	{
-		RemoveRectangleFromBatch ( id );
-		AddRectangleToBatch ( id, texture );
+		// Acquire first so a texture set again on the same rectangle isn't reloaded
+		auto handle { AcquireTexture ( texture ) };
+
+		if ( auto textureIt { rectangleTextures.find ( id ) }; textureIt != rectangleTextures.end () )
+			ReleaseTexture ( textureIt->second );
+
+		rectangleTextures [ id ] = handle;
+		instanceFragmentDatas [ id ].textureIndex = static_cast < uint32_t > ( textureTable.at ( handle ).index );
+
+		for ( auto & frame : frameInstanceBuffers )
+			frame.dirtyFragmentDatas.Add ( id );
+
+		bool textured { texture != defaultTexture };
+		SetInstanceVariant ( id, ( instanceVariants [ id ] & ~texturedVariant ) | ( textured ? texturedVariant : 0 ) );
 	}
 
-	void Recterer::AddRectangleToBatch ( int rectangleId, std::string const & batchTexture )
+	void Recterer::SetInstanceVariant ( int id, int variant )
 	{
-		auto batchIt { batches.find ( batchTexture ) };
+		auto current { instanceVariants [ id ] };
 
-		if ( batchIt == batches.end () )
-		{
-			Batch batch;
+		// One group at a time, swapping with the slot at the group's edge and moving the edge past it
+		for ( ; current < variant; ++current )
+			SwapSlots ( instanceSlots.at ( id ), --variantEnds [ current ] );
 
-			CreateTexture ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue,
-				deps.queues->transferQueueFamilyIndex, batchTexture, batch.texture, batch.textureView, batch.textureMemory );
+		for ( ; current > variant; --current )
+			SwapSlots ( instanceSlots.at ( id ), variantEnds [ current - 1 ]++ );
 
-			batch.descriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, batchDescriptorSetLayout );
+		instanceVariants [ id ] = variant;
+	}
 
-			batchIt = batches.insert ( { batchTexture, batch } ).first;
-		
-			vk::DescriptorImageInfo imageInfo { {}, batchIt->second.textureView, vk::ImageLayout::eShaderReadOnlyOptimal };
+	void Recterer::SwapSlots ( int first, int second )
+	{
+		if ( first == second )
+			return;
 
-			std::vector <vk::WriteDescriptorSet> writes {
-				{ batchIt->second.descriptorSet, 1, 0, 1, vk::DescriptorType::eSampledImage, &imageInfo, {} },
-			};
+		std::swap ( instanceIndices [ first ], instanceIndices [ second ] );
+		instanceSlots [ static_cast < int > ( instanceIndices [ first ] ) ] = first;
+		instanceSlots [ static_cast < int > ( instanceIndices [ second ] ) ] = second;
 
-			deps.device.updateDescriptorSets ( writes, {} );
+		for ( auto & frame : frameInstanceBuffers )
+		{
+			frame.dirtyInstanceIndices.Add ( first );
+			frame.dirtyInstanceIndices.Add ( second );
 		}
-		
-		batchIt->second.instanceIndices.push_back ( { rectangleId, 0, 0, 0 } );
-		
-		deps.device.destroy ( batchIt->second.instanceIndexBuffer );
-		deps.device.free ( batchIt->second.instanceIndexBufferMemory );
-
-		CreateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue, 
-			BufferUsages::uniformBuffer,
-			batchIt->second.instanceIndices.data (),
-			batchIt->second.instanceIndices.size () * sizeof ( glm::vec4 ),
-			batchIt->second.instanceIndexBuffer,
-			batchIt->second.instanceIndexBufferMemory
-		);
-
-		vk::DescriptorBufferInfo bufferInfo { batchIt->second.instanceIndexBuffer, 0, batchIt->second.instanceIndices.size () * sizeof ( glm::vec4 ) };
-		
+	}
+
+	void Recterer::DirtyRange::Add ( int id )
+	{
+		begin = std::min ( begin, id );
+		end = std::max ( end, id + 1 );
+	}
+
+	void Recterer::GrowFrameInstanceBuffers ( FrameInstanceBuffers & frame, int capacity )
+	{
+		// Only called for a frame the GPU is done with, its old buffers can go right away
+		DestroyFrameInstanceBuffers ( frame );
+
+		frame.transformsBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Recterer", BufferUsages::storageBuffer,
+			capacity * sizeof ( glm::mat4 ), frame.transformsBuffer, frame.transformsBufferAllocation ) );
+
+		frame.fragmentDatasBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Recterer", BufferUsages::storageBuffer,
+			capacity * sizeof ( InstanceFragmentShaderData ), frame.fragmentDatasBuffer, frame.fragmentDatasBufferAllocation ) );
+
+		// There are never more live rectangles than ids handed out
+		frame.instanceIndexBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Recterer", BufferUsages::storageBuffer,
+			capacity * sizeof ( uint32_t ), frame.instanceIndexBuffer, frame.instanceIndexBufferAllocation ) );
+
+		frame.capacity = capacity;
+
+		// The new buffers start out empty
+		frame.dirtyTransforms = { 0, rectangleIDManager.GetUpperBound () };
+		frame.dirtyFragmentDatas = { 0, rectangleIDManager.GetUpperBound () };
+		frame.dirtyInstanceIndices = { 0, static_cast < int > ( instanceIndices.size () ) };
+
+		vk::DescriptorBufferInfo transformsBufferInfo { frame.transformsBuffer, 0, VK_WHOLE_SIZE };
+		vk::DescriptorBufferInfo fragmentDatasBufferInfo { frame.fragmentDatasBuffer, 0, VK_WHOLE_SIZE };
+		vk::DescriptorBufferInfo instanceIndexBufferInfo { frame.instanceIndexBuffer, 0, VK_WHOLE_SIZE };
+
 		std::vector <vk::WriteDescriptorSet> writes {
-			{ batchIt->second.descriptorSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &bufferInfo },
+			{ frame.globalDescriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &transformsBufferInfo },
+			{ frame.globalDescriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &fragmentDatasBufferInfo },
+			{ frame.globalDescriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &instanceIndexBufferInfo }
 		};
 
 		deps.device.updateDescriptorSets ( writes, {} );
-		
-		rectangleTextures [ rectangleId ] = batchTexture;
 	}
 
-	void Recterer::RemoveRectangleFromBatch ( int rectangleId )
+	void Recterer::DestroyFrameInstanceBuffers ( FrameInstanceBuffers & frame )
 	{
-		if ( rectangleTextures.find ( rectangleId ) == rectangleTextures.end () )
+		DestroyBuffer ( deps.allocator, frame.transformsBuffer, frame.transformsBufferAllocation );
+		DestroyBuffer ( deps.allocator, frame.fragmentDatasBuffer, frame.fragmentDatasBufferAllocation );
+		DestroyBuffer ( deps.allocator, frame.instanceIndexBuffer, frame.instanceIndexBufferAllocation );
+
+		frame.transformsBufferAllocation = {};
+		frame.fragmentDatasBufferAllocation = {};
+		frame.instanceIndexBufferAllocation = {};
+		frame.capacity = 0;
+	}
+
+	void Recterer::WriteDirtyRange ( DirtyRange & range, void const * source, vk::DeviceSize elementSize,
+		VmaAllocation allocation, std::byte * mappedData )
+	{
+		if ( range.begin >= range.end )
 			return;
 
-		auto & batch { batches.find ( rectangleTextures.at ( rectangleId ) )->second };
+		// One copy and one flush covering every change since this frame last rendered
+		auto offset { range.begin * elementSize };
+		auto size { ( range.end - range.begin ) * elementSize };
 
-		if ( batch.instanceIndices.size () == 1 )
-		{
-			DeleteBatch ( batch );
-			batches.erase ( rectangleTextures.at ( rectangleId ) );
+		std::memcpy ( mappedData + offset, static_cast < std::byte const * > ( source ) + offset, size );
+		vmaFlushAllocation ( deps.allocator, allocation, offset, size );
+
+		range = {};
+	}
+
+	void Recterer::WritePendingTextures ( FrameInstanceBuffers & frame )
+	{
+		if ( frame.pendingTextures.empty () )
 			return;
+
+		std::vector <vk::DescriptorImageInfo> imageInfos;
+		imageInfos.reserve ( frame.pendingTextures.size () );
+
+		std::vector <vk::WriteDescriptorSet> writes;
+
+		for ( auto index : frame.pendingTextures )
+		{
+			// Released again before this frame got to it
+			if ( ! textureViews [ index ] )
+				continue;
+
+			imageInfos.push_back ( { {}, textureViews [ index ], vk::ImageLayout::eShaderReadOnlyOptimal } );
+			writes.push_back ( { frame.globalDescriptorSet, 5, static_cast < uint32_t > ( index ), 1, vk::DescriptorType::eSampledImage, &imageInfos.back (), {} } );
 		}
 
-		batch.instanceIndices.erase ( 
-			std::find ( batch.instanceIndices.begin (), batch.instanceIndices.end (), 
-				glm::vec4 { rectangleId, 0, 0, 0 } ) );
+		if ( ! writes.empty () )
+			deps.device.updateDescriptorSets ( writes, {} );
 
-		deps.device.destroy ( batch.instanceIndexBuffer );
-		deps.device.free ( batch.instanceIndexBufferMemory );
+		frame.pendingTextures.clear ();
+	}
 
-		CreateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue,
-			BufferUsages::uniformBuffer,
-			batch.instanceIndices.data (),
-			batch.instanceIndices.size () * sizeof ( glm::vec4 ),
-			batch.instanceIndexBuffer,
-			batch.instanceIndexBufferMemory
-		);
+	TextureCache::Handle Recterer::AcquireTexture ( std::string const & path )
+	{
+		auto handle { deps.textureCache->Acquire ( path ) };
+		auto entryIt { textureTable.find ( handle ) };
 
-		vk::DescriptorBufferInfo bufferInfo { batch.instanceIndexBuffer, 0, batch.instanceIndices.size () * sizeof ( glm::vec4 ) };
+		if ( entryIt == textureTable.end () )
+		{
+			TableEntry entry { textureIndexManager.GetID () };
 
-		std::vector <vk::WriteDescriptorSet> writes {
-			{ batch.descriptorSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &bufferInfo },
-		};
+			textureViews [ entry.index ] = deps.textureCache->GetView ( handle );
 
-		deps.device.updateDescriptorSets ( writes, {} );
+			// Frames write the new table entry when they next record, their sets may be in use until then
+			for ( auto & frame : frameInstanceBuffers )
+				frame.pendingTextures.push_back ( entry.index );
 
-		rectangleTextures.erase ( rectangleId );
+			entryIt = textureTable.insert ( { handle, entry } ).first;
+		}
+
+		++entryIt->second.referenceCount;
+		return handle;
+	}
+
+	void Recterer::ReleaseTexture ( TextureCache::Handle handle )
+	{
+		deps.textureCache->Release ( handle );
+
+		auto entryIt { textureTable.find ( handle ) };
+
+		if ( --entryIt->second.referenceCount > 0 )
+			return;
+
+		// The cache keeps the image alive for frames in flight, the index is only reused by textures added after this
+		textureViews [ entryIt->second.index ] = nullptr;
+		textureIndexManager.FreeID ( entryIt->second.index );
+		textureTable.erase ( entryIt );
 	}
 
 	vk::PipelineLayout Recterer::CreatePipelineLayout ()
 	{
 		std::vector <vk::PushConstantRange> pushConstantRanges {};
-		return pd::CreatePipelineLayout ( deps.device, { globalDescriptorSetLayout, batchDescriptorSetLayout }, pushConstantRanges );
+		return pd::CreatePipelineLayout ( deps.device, { globalDescriptorSetLayout }, pushConstantRanges );
 	}
 
-	vk::Pipeline Recterer::CreatePipeline ()
+	vk::Pipeline Recterer::CreatePipeline ( int variant )
 	{
-		vk::ShaderModule vertexShader { CreateShaderModuleFromFile ( deps.device, "shader/build/GUIShader.spv.vert" ) };
-		vk::ShaderModule fragmentShader { CreateShaderModuleFromFile ( deps.device, "shader/build/GUIShader.spv.frag" ) };
+		vk::ShaderModule vertexShader { CreateShaderModule ( deps.device, shader::guiVertexShader ) };
+		vk::ShaderModule fragmentShader { CreateShaderModule ( deps.device, shader::guiFragmentShader ) };
+
+		// The fragment shader leaves out the texture read and the border test for variants without them
+		std::array <vk::Bool32, 2> constants { ( variant & texturedVariant ) != 0, ( variant & borderedVariant ) != 0 };
+		std::array <vk::SpecializationMapEntry, 2> entries { { { 0, 0, sizeof ( vk::Bool32 ) }, { 1, sizeof ( vk::Bool32 ), sizeof ( vk::Bool32 ) } } };
+		vk::SpecializationInfo specialization { static_cast < uint32_t > ( entries.size () ), entries.data (), sizeof ( constants ), constants.data () };
 
 		std::vector <vk::PipelineShaderStageCreateInfo> shaderStages
 		{
 			{ {}, vk::ShaderStageFlagBits::eVertex, vertexShader, "main" },
-			{ {}, vk::ShaderStageFlagBits::eFragment, fragmentShader, "main" }
+			{ {}, vk::ShaderStageFlagBits::eFragment, fragmentShader, "main", &specialization }
 		};
 
 		std::vector <vk::VertexInputBindingDescription> vertexBindings { { 0, sizeof ( float ) * ( 2 + 2 ), vk::VertexInputRate::eVertex } };
@@ -377,7 +534,7 @@ namespace pd
 			0,
 		};
 
-		auto pipeline { deps.device.createGraphicsPipeline ( {}, createInfo ).value };
+		auto pipeline { deps.device.createGraphicsPipeline ( deps.pipelineCache->Get (), createInfo ).value };
 
 		deps.device.destroy ( vertexShader );
 		deps.device.destroy ( fragmentShader );
@@ -396,20 +553,10 @@ namespace pd
 
 		std::vector <uint32_t> indices { 0, 1, 2, 2, 3, 0 };
 
-		CreateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue, BufferUsages::vertexBuffer,
-			vertices.data (), vertices.size () * sizeof ( float ), vertexBuffer, vertexBufferMemory );
+		CreateBuffer ( deps.allocator, "Recterer", *deps.stagingRing, BufferUsages::vertexBuffer,
+			vertices.data (), vertices.size () * sizeof ( float ), vertexBuffer, vertexBufferAllocation );
 
-		CreateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue, BufferUsages::indexBuffer,
-			indices.data (), indices.size () * sizeof ( uint32_t ), indexBuffer, indexBufferMemory );
-	}
-
-	void Recterer::DeleteBatch ( Batch const & batch )
-	{
-		deps.device.destroy ( batch.instanceIndexBuffer );
-		deps.device.free ( batch.instanceIndexBufferMemory );
-		deps.device.destroy ( batch.texture );
-		deps.device.destroy ( batch.textureView );
-		deps.device.free ( batch.textureMemory );
-		deps.device.free ( descriptorPool, batch.descriptorSet );
+		CreateBuffer ( deps.allocator, "Recterer", *deps.stagingRing, BufferUsages::indexBuffer,
+			indices.data (), indices.size () * sizeof ( uint32_t ), indexBuffer, indexBufferAllocation );
 	}
-}
\ No newline at end of file
+}
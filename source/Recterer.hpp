@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Core.hpp"
+#include "StagingRing.hpp"
+#include "PipelineCache.hpp"
+#include "TextureCache.hpp"
 #include "IDManager.hpp"
 
 namespace pd
@@ -12,15 +15,19 @@ namespace pd
 		{
 			vk::PhysicalDevice physicalDevice;
 			vk::Device device;
+			VmaAllocator allocator;
 			DeviceQueues const * queues;
 			vk::RenderPass renderPass;
-			vk::CommandPool transferCommandPool;
+			StagingRing * stagingRing;
+			uint32_t framesInFlight;
+			TextureCache * textureCache;
+			PipelineCache * pipelineCache;
 		};
 
 		void Initialize ( Dependencies const & );
 		void Shutdown ();
 
-		void RecordRender ( vk::CommandBuffer, vk::Extent2D viewportExtent );
+		void RecordRender ( vk::CommandBuffer, vk::Extent2D viewportExtent, uint32_t frameIndex );
 		
 		void SetViewportSize ( glm::vec2 const & size );
 
@@ -33,29 +40,38 @@ namespace pd
 		void SetRectangleBorderColor ( int id, glm::vec4 const & );
 
 	private:
-		static inline constexpr int maxInstances { 10000 };
+		static inline constexpr int initialInstanceCapacity { 64 };
 
-		struct Batch
-		{
-			vk::Image texture;
-			vk::DeviceMemory textureMemory;
-			vk::ImageView textureView;
+		// Size of the texture table every rectangle indexes into
+		static inline constexpr int maxTextures { 1024 };
 
-			std::vector <glm::vec4> instanceIndices;
-			vk::Buffer instanceIndexBuffer {};
-			vk::DeviceMemory instanceIndexBufferMemory {};
+		// Rectangles without a texture of their own sample nothing
+		static inline constexpr char const * defaultTexture { "image/White.png" };
+
+		// Bits of a rectangle's shader variant, each variant is its own pipeline specialized from the same shaders
+		static inline constexpr int texturedVariant { 1 };
+		static inline constexpr int borderedVariant { 2 };
+		static inline constexpr int variantCount { 4 };
+
+		// Instances changed since a frame's copy of the instance buffers was last written
+		struct DirtyRange
+		{
+			int begin { std::numeric_limits <int>::max () };
+			int end { 0 };
 
-			vk::DescriptorSet descriptorSet;
+			void Add ( int id );
 		};
 
-		struct CameraData
+		// A cached texture's place in the texture table
+		struct TableEntry
 		{
-			glm::mat4 projectionMatrix;
+			int index;
+			int referenceCount { 0 };
 		};
 
-		struct InstanceTransformsData
+		struct CameraData
 		{
-			glm::mat4 transforms [ maxInstances ];
+			glm::mat4 projectionMatrix;
 		};
 
 		struct InstanceFragmentShaderData
@@ -63,21 +79,49 @@ namespace pd
 			glm::vec4 color;
 			glm::vec4 borderColor;
 			glm::vec4 borderSizes;
+			uint32_t textureIndex;
+			uint32_t padding [ 3 ];
 		};
 
-		/*struct InstanceColorsData
+		// Each frame in flight renders from its own copy of the instance data
+		struct FrameInstanceBuffers
 		{
-			glm::vec4 colors [ maxInstances ];
-		};*/
+			vk::Buffer transformsBuffer {};
+			VmaAllocation transformsBufferAllocation {};
+			std::byte * transformsBufferData { nullptr };
 
-		void AddRectangleToBatch ( int rectangleId, std::string const & batchTexture );
-		void RemoveRectangleFromBatch ( int rectangleId );
+			vk::Buffer fragmentDatasBuffer {};
+			VmaAllocation fragmentDatasBufferAllocation {};
+			std::byte * fragmentDatasBufferData { nullptr };
 
-		Batch CreateBatch ( std::string const & texture, std::vector <int> instanceIndices );
-		void DeleteBatch ( Batch const & );
+			vk::Buffer instanceIndexBuffer {};
+			VmaAllocation instanceIndexBufferAllocation {};
+			std::byte * instanceIndexBufferData { nullptr };
+
+			int capacity { 0 };
+			DirtyRange dirtyTransforms;
+			DirtyRange dirtyFragmentDatas;
+			DirtyRange dirtyInstanceIndices;
+
+			// Texture table entries to write before the frame's descriptor set is next bound
+			std::vector <int> pendingTextures;
+
+			vk::DescriptorSet globalDescriptorSet;
+		};
+
+		void GrowFrameInstanceBuffers ( FrameInstanceBuffers &, int capacity );
+		void DestroyFrameInstanceBuffers ( FrameInstanceBuffers & );
+		void WriteDirtyRange ( DirtyRange &, void const * source, vk::DeviceSize elementSize, VmaAllocation, std::byte * mappedData );
+		void WritePendingTextures ( FrameInstanceBuffers & );
+
+		TextureCache::Handle AcquireTexture ( std::string const & path );
+		void ReleaseTexture ( TextureCache::Handle );
+
+		void SetInstanceVariant ( int id, int variant );
+		void SwapSlots ( int first, int second );
 
 		vk::PipelineLayout CreatePipelineLayout ();
-		vk::Pipeline CreatePipeline ();
+		vk::Pipeline CreatePipeline ( int variant );
 		void CreateGeometryBuffers ();
 
 
@@ -87,31 +131,42 @@ namespace pd
 		vk::Sampler sampler;
 
 		vk::DescriptorSetLayout globalDescriptorSetLayout;
-		vk::DescriptorSetLayout batchDescriptorSetLayout;
 
 		vk::PipelineLayout pipelineLayout;
-		vk::Pipeline pipeline;
+		vk::Pipeline pipelines [ variantCount ];
 
 		vk::Buffer vertexBuffer;
-		vk::DeviceMemory vertexBufferMemory;
+		VmaAllocation vertexBufferAllocation;
 		vk::Buffer indexBuffer;
-		vk::DeviceMemory indexBufferMemory;
+		VmaAllocation indexBufferAllocation;
 		
+		// One copy per frame in flight, selected with a dynamic offset
+		CameraData cameraData;
 		vk::Buffer cameraUniformBuffer;
-		vk::DeviceMemory cameraUniformBufferMemory;
+		VmaAllocation cameraUniformBufferAllocation;
+		std::byte * cameraUniformBufferData;
+		vk::DeviceSize cameraUniformBufferStride;
+
+		// CPU side copies of the instance data, indexed by rectangle id
+		std::vector <glm::mat4> instanceTransforms;
+		std::vector <InstanceFragmentShaderData> instanceFragmentDatas;
 
-		vk::Buffer instanceTransformsBuffer;
-		vk::DeviceMemory instanceTransformsBufferMemory;
+		// Ids of live rectangles in draw order, and the slot each id occupies
+		std::vector <uint32_t> instanceIndices;
+		std::unordered_map < int, int > instanceSlots;
 
-		vk::Buffer instanceColorsBuffer;
-		vk::DeviceMemory instanceColorsBufferMemory;
+		// Slots are grouped by variant, each group ends where the next begins and is drawn with its own pipeline
+		std::vector <int> instanceVariants;
+		std::array < int, variantCount > variantEnds {};
 
-		vk::DescriptorSet globalDescriptorSet;
+		std::vector <FrameInstanceBuffers> frameInstanceBuffers;
 		
 		IDManager rectangleIDManager;
 
-		std::unordered_map < std::string, Batch> batches;
-		std::unordered_map < int, std::string > rectangleTextures;
+		std::unordered_map < TextureCache::Handle, TableEntry > textureTable;
+		std::vector <vk::ImageView> textureViews;
+		IDManager textureIndexManager { 0, maxTextures - 1 };
+		std::unordered_map < int, TextureCache::Handle > rectangleTextures;
 		friend class Rectangle;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,413 @@
+#include "SceneCache.hpp"
+#include "ObjLoader.hpp"
+#include "MappedFile.hpp"
+#include "MeshSimplifier.hpp"
+#include "Core.hpp"
+
+namespace pd
+{
+	namespace
+	{
+		// Bump whenever the file layout or the SceneData structures change
+		constexpr uint32_t cacheVersion { 3 };
+		constexpr char cacheMagic [ 4 ] { 'P', 'D', 'S', 'C' };
+
+		// Sections start aligned so they can be viewed in place
+		constexpr std::size_t sectionAlignment { 16 };
+
+		struct Section
+		{
+			uint64_t offset;
+			uint64_t size;
+		};
+
+		struct Header
+		{
+			char magic [ 4 ];
+			uint32_t version;
+
+			// Files the scene was built from, with the size and write time they had
+			Section dependencies;
+
+			Section vertices;
+			Section indices;
+			Section objects;
+			Section materials;
+			Section texturePaths;
+		};
+
+		struct FileStamp
+		{
+			uint64_t size;
+			int64_t writeTime;
+
+			bool operator == ( FileStamp const & ) const = default;
+		};
+
+		struct BuiltScene
+		{
+			std::vector <float> vertices;
+			std::vector <uint32_t> indices;
+			std::vector <SceneData::Object> objects;
+			std::vector <SceneData::Material> materials;
+		};
+
+		// Reads values stored back to back without any alignment
+		class ByteReader
+		{
+		public:
+			ByteReader ( std::string_view bytes ) : bytes { bytes } {}
+
+			template < typename T >
+			T Read ()
+			{
+				if ( bytes.size () < sizeof ( T ) )
+					throw std::runtime_error { "Scene cache is truncated" };
+
+				T value;
+				std::memcpy ( &value, bytes.data (), sizeof ( T ) );
+				bytes.remove_prefix ( sizeof ( T ) );
+
+				return value;
+			}
+
+			std::string ReadString ()
+			{
+				auto length { Read <uint32_t> () };
+
+				if ( bytes.size () < length )
+					throw std::runtime_error { "Scene cache is truncated" };
+
+				std::string string { bytes.substr ( 0, length ) };
+				bytes.remove_prefix ( length );
+
+				return string;
+			}
+
+			bool IsEmpty () const { return bytes.empty (); }
+
+		private:
+			std::string_view bytes;
+		};
+
+		std::filesystem::path GetCachePath ( std::filesystem::path const & objPath )
+		{
+			return std::filesystem::path { objPath }.replace_extension ( ".pdscene" );
+		}
+
+		std::optional <FileStamp> GetFileStamp ( std::filesystem::path const & path )
+		{
+			std::error_code error;
+
+			auto size { std::filesystem::file_size ( path, error ) };
+
+			if ( error )
+				return {};
+
+			auto writeTime { std::filesystem::last_write_time ( path, error ) };
+
+			if ( error )
+				return {};
+
+			return FileStamp { size, static_cast < int64_t > ( writeTime.time_since_epoch ().count () ) };
+		}
+
+		SceneData BuildSceneData ( std::filesystem::path const & objPath, std::vector <std::filesystem::path> & dependencies )
+		{
+			auto scene { obj::Load ( objPath ) };
+
+			dependencies.push_back ( objPath );
+			dependencies.insert ( dependencies.end (), scene.materialLibraries.begin (), scene.materialLibraries.end () );
+
+			auto built { std::make_shared <BuiltScene> () };
+
+			SceneData data;
+
+			// Textures are referenced by absolute path, the cache may be read from another working directory
+			data.texturePaths.push_back ( std::filesystem::absolute ( "image/White.png" ).generic_string () );
+
+			std::unordered_map < std::string, uint32_t > textureIndices;
+
+			auto addTexture { [ & ] ( std::string const & path ) -> uint32_t {
+				if ( path.empty () )
+					return 0;
+
+				auto absolutePath { std::filesystem::absolute ( path ).generic_string () };
+				auto [ textureIt, inserted ] { textureIndices.try_emplace ( absolutePath, static_cast < uint32_t > ( data.texturePaths.size () ) ) };
+
+				if ( inserted )
+					data.texturePaths.push_back ( absolutePath );
+
+				return textureIt->second;
+			} };
+
+			built->vertices.reserve ( scene.vertices.size () * SceneData::vertexComponents );
+
+			for ( auto const & vertex : scene.vertices )
+			{
+				built->vertices.push_back ( vertex.position.x );
+				built->vertices.push_back ( vertex.position.y );
+				built->vertices.push_back ( vertex.position.z );
+
+				built->vertices.push_back ( vertex.textureCoordinates.x );
+				built->vertices.push_back ( vertex.textureCoordinates.y );
+			}
+
+			built->indices = std::move ( scene.indices );
+
+			// Material 0 is for meshes without one
+			built->materials.push_back ( {} );
+
+			for ( auto const & material : scene.materials )
+			{
+				auto orWhite { [] ( glm::vec3 const & color ) {
+					return glm::vec4 { color == glm::zero <glm::vec3> () ? glm::one <glm::vec3> () : color, 1.0f };
+				} };
+
+				built->materials.push_back ( { orWhite ( material.ambientColor ), orWhite ( material.diffuseColor ), orWhite ( material.specularColor ) } );
+			}
+
+			for ( auto const & mesh : scene.meshes )
+			{
+				SceneData::Object object { { { mesh.indexOffset, mesh.indexCount } }, 1, 0, { 0, 0, 0 }, {}, {} };
+
+				if ( mesh.indexCount > 0 )
+				{
+					object.boundsMin = object.boundsMax = scene.vertices [ built->indices [ mesh.indexOffset ] ].position;
+
+					for ( auto index : std::span { built->indices }.subspan ( mesh.indexOffset, mesh.indexCount ) )
+					{
+						object.boundsMin = glm::min ( object.boundsMin, scene.vertices [ index ].position );
+						object.boundsMax = glm::max ( object.boundsMax, scene.vertices [ index ].position );
+					}
+				}
+
+				if ( mesh.material != -1 )
+				{
+					auto const & material { scene.materials [ mesh.material ] };
+
+					object.material = static_cast < uint32_t > ( mesh.material + 1 );
+					object.textures [ 0 ] = addTexture ( material.ambientMap );
+					object.textures [ 1 ] = addTexture ( material.diffuseMap );
+				}
+
+				built->objects.push_back ( object );
+			}
+
+			// Each level aims for half the triangles of the one before, with an error bound relative to the object's size
+			std::vector <std::vector <std::vector <uint32_t>>> objectLods ( built->objects.size () );
+
+			ParallelFor ( built->objects.size (), [ & ] ( std::size_t objectIndex ) {
+				auto const & object { built->objects [ objectIndex ] };
+				auto radius { glm::length ( object.boundsMax - object.boundsMin ) * 0.5f };
+				auto previous { std::span <uint32_t const> { built->indices }.subspan ( object.lods [ 0 ].indexOffset, object.lods [ 0 ].indexCount ) };
+
+				for ( std::size_t level { 1 }; level < SceneData::maxLods; ++level )
+				{
+					auto maxError { 0.01f * static_cast < float > ( 1 << ( level - 1 ) ) * radius };
+					auto simplified { SimplifyMesh ( built->vertices, SceneData::vertexComponents, previous, previous.size () / 2, maxError ) };
+
+					// Not worth a level of its own
+					if ( simplified.empty () || simplified.size () * 4 > previous.size () * 3 )
+						break;
+
+					objectLods [ objectIndex ].push_back ( std::move ( simplified ) );
+					previous = objectLods [ objectIndex ].back ();
+				}
+			} );
+
+			for ( std::size_t objectIndex { 0 }; objectIndex < built->objects.size (); ++objectIndex )
+			{
+				auto & object { built->objects [ objectIndex ] };
+
+				for ( auto const & lodIndices : objectLods [ objectIndex ] )
+				{
+					object.lods [ object.lodCount++ ] = { static_cast < uint32_t > ( built->indices.size () ), static_cast < uint32_t > ( lodIndices.size () ) };
+					built->indices.insert ( built->indices.end (), lodIndices.begin (), lodIndices.end () );
+				}
+
+				for ( auto level { object.lodCount }; level < SceneData::maxLods; ++level )
+					object.lods [ level ] = object.lods [ object.lodCount - 1 ];
+			}
+
+			data.vertices = built->vertices;
+			data.indices = built->indices;
+			data.objects = built->objects;
+			data.materials = built->materials;
+			data.storage = built;
+
+			return data;
+		}
+
+		void WriteCache ( std::filesystem::path const & cachePath, SceneData const & data, std::vector <std::filesystem::path> const & dependencies )
+		{
+			std::string bytes ( sizeof ( Header ), '\0' );
+
+			auto append { [ & ] ( void const * source, std::size_t size ) {
+				bytes.append ( static_cast < char const * > ( source ), size );
+			} };
+
+			auto appendString { [ & ] ( std::string const & string ) {
+				auto length { static_cast < uint32_t > ( string.size () ) };
+				append ( &length, sizeof ( length ) );
+				append ( string.data (), string.size () );
+			} };
+
+			auto beginSection { [ & ] () {
+				bytes.resize ( ( bytes.size () + sectionAlignment - 1 ) / sectionAlignment * sectionAlignment, '\0' );
+				return Section { bytes.size (), 0 };
+			} };
+
+			auto endSection { [ & ] ( Section & section ) {
+				section.size = bytes.size () - section.offset;
+			} };
+
+			Header header {};
+			std::memcpy ( header.magic, cacheMagic, sizeof ( cacheMagic ) );
+			header.version = cacheVersion;
+
+			header.dependencies = beginSection ();
+
+			for ( auto const & dependency : dependencies )
+			{
+				auto stamp { GetFileStamp ( dependency ) };
+
+				if ( ! stamp )
+					throw std::runtime_error { "Couldn't read the size and write time of dependency " + dependency.generic_string () };
+
+				append ( &*stamp, sizeof ( FileStamp ) );
+				appendString ( std::filesystem::absolute ( dependency ).generic_string () );
+			}
+
+			endSection ( header.dependencies );
+
+			header.vertices = beginSection ();
+			append ( data.vertices.data (), data.vertices.size_bytes () );
+			endSection ( header.vertices );
+
+			header.indices = beginSection ();
+			append ( data.indices.data (), data.indices.size_bytes () );
+			endSection ( header.indices );
+
+			header.objects = beginSection ();
+			append ( data.objects.data (), data.objects.size_bytes () );
+			endSection ( header.objects );
+
+			header.materials = beginSection ();
+			append ( data.materials.data (), data.materials.size_bytes () );
+			endSection ( header.materials );
+
+			header.texturePaths = beginSection ();
+
+			for ( auto const & texturePath : data.texturePaths )
+				appendString ( texturePath );
+
+			endSection ( header.texturePaths );
+
+			std::memcpy ( bytes.data (), &header, sizeof ( Header ) );
+
+			WriteFileAtomically ( cachePath, { std::as_bytes ( std::span { bytes } ) } );
+		}
+
+		std::optional <SceneData> ReadCache ( std::filesystem::path const & cachePath )
+		{
+			if ( ! std::filesystem::exists ( cachePath ) )
+				return {};
+
+			auto file { std::make_shared <MappedFile> ( cachePath ) };
+			auto contents { file->GetContents () };
+
+			if ( contents.size () < sizeof ( Header ) )
+				return {};
+
+			Header header;
+			std::memcpy ( &header, contents.data (), sizeof ( Header ) );
+
+			if ( std::memcmp ( header.magic, cacheMagic, sizeof ( cacheMagic ) ) != 0 || header.version != cacheVersion )
+				return {};
+
+			for ( auto const & section : { header.dependencies, header.vertices, header.indices, header.objects, header.materials, header.texturePaths } )
+			{
+				if ( section.offset % sectionAlignment != 0 || section.offset > contents.size () || section.size > contents.size () - section.offset )
+					return {};
+			}
+
+			auto sectionBytes { [ & ] ( Section const & section ) {
+				return contents.substr ( section.offset, section.size );
+			} };
+
+			// Stale once any file it was built from changed
+			for ( ByteReader reader { sectionBytes ( header.dependencies ) }; ! reader.IsEmpty (); )
+			{
+				auto stamp { reader.Read <FileStamp> () };
+
+				if ( GetFileStamp ( reader.ReadString () ) != stamp )
+					return {};
+			}
+
+			auto view { [ & ] < typename T > ( Section const & section, std::span <T const> & span ) {
+				if ( section.size % sizeof ( T ) != 0 )
+					throw std::runtime_error { "Scene cache has a section that isn't a whole number of elements" };
+
+				span = { reinterpret_cast < T const * > ( contents.data () + section.offset ), section.size / sizeof ( T ) };
+			} };
+
+			SceneData data;
+
+			view ( header.vertices, data.vertices );
+			view ( header.indices, data.indices );
+			view ( header.objects, data.objects );
+			view ( header.materials, data.materials );
+
+			if ( data.vertices.size () % SceneData::vertexComponents != 0 )
+				throw std::runtime_error { "Scene cache has a section that isn't a whole number of elements" };
+
+			for ( ByteReader reader { sectionBytes ( header.texturePaths ) }; ! reader.IsEmpty (); )
+				data.texturePaths.push_back ( reader.ReadString () );
+
+			// Everything the objects refer to is indexed with on upload, unchecked
+			for ( auto const & object : data.objects )
+			{
+				auto lodInRange { [ & ] ( SceneData::Lod const & lod ) {
+					return lod.indexOffset <= data.indices.size () && lod.indexCount <= data.indices.size () - lod.indexOffset;
+				} };
+
+				if ( object.lodCount == 0 || object.lodCount > SceneData::maxLods || object.material >= data.materials.size ()
+					|| ! std::ranges::all_of ( object.textures, [ & ] ( uint32_t texture ) { return texture < data.texturePaths.size (); } )
+					|| ! std::ranges::all_of ( object.lods, lodInRange ) )
+					throw std::runtime_error { "Scene cache has an object referring past the end of a section" };
+			}
+
+			data.storage = file;
+
+			return data;
+		}
+	}
+
+	SceneData LoadSceneData ( std::filesystem::path const & objPath )
+	{
+		auto cachePath { GetCachePath ( objPath ) };
+
+		try
+		{
+			if ( auto cached { ReadCache ( cachePath ) } )
+			{
+				std::cout << "Using scene cache " << cachePath.generic_string () << std::endl;
+				return std::move ( *cached );
+			}
+		}
+		catch ( std::exception const & exception )
+		{
+			std::cout << "Ignoring scene cache " << cachePath.generic_string () << ": " << exception.what () << std::endl;
+		}
+
+		std::vector <std::filesystem::path> dependencies;
+		auto data { BuildSceneData ( objPath, dependencies ) };
+
+		TryWriteCache ( "scene", cachePath, [ & ] () {
+			WriteCache ( cachePath, data, dependencies );
+		} );
+
+		return data;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+	Scenes converted to the layout Axel uploads, cached in a binary file next to their OBJ.
+	The cache is only used while the OBJ and material files it was built from keep their
+	size and modification time. It is memory mapped, so loading it is handing its sections
+	straight to the staging ring without parsing anything.
+*/
+
+namespace pd
+{
+	struct SceneData
+	{
+		// Levels of detail each object is simplified to, the first is the full mesh
+		static inline constexpr std::size_t maxLods { 4 };
+
+		struct Lod
+		{
+			uint32_t indexOffset;
+			uint32_t indexCount;
+		};
+
+		struct Object
+		{
+			// Levels past lodCount repeat the last one
+			Lod lods [ maxLods ];
+			uint32_t lodCount;
+			uint32_t material;
+
+			// Ambient, diffuse and specular, indices into texturePaths
+			uint32_t textures [ 3 ];
+
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+		};
+
+		struct Material
+		{
+			glm::vec4 ambientColor { 1.0f, 1.0f, 1.0f, 1.0f };
+			glm::vec4 diffuseColor { 1.0f, 1.0f, 1.0f, 1.0f };
+			glm::vec4 specularColor { 1.0f, 1.0f, 1.0f, 1.0f };
+		};
+
+		// Interleaved position and texture coordinates
+		static inline constexpr std::size_t vertexComponents { 3 + 2 };
+
+		std::span <float const> vertices;
+		std::span <uint32_t const> indices;
+		std::span <Object const> objects;
+		std::span <Material const> materials;
+		std::vector <std::string> texturePaths;
+
+		// Owns what the spans view, the mapped cache file or the arrays built from the OBJ
+		std::shared_ptr <void const> storage;
+	};
+
+	// Reads the cache next to the OBJ if it is current, otherwise builds the scene and rewrites the cache
+	SceneData LoadSceneData ( std::filesystem::path const & objPath );
+}
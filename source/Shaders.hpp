@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+	SPIR-V of every shader in shader/source, compiled by the build into headers of constant word arrays.
+	Pipelines are created straight from these, startup reads no shader files. Variants of a shader
+	are picked with specialization constants when its pipeline is created, see the constant_id
+	declarations in the sources.
+*/
+
+namespace pd::shader
+{
+	#include "shader/shader.spv.vert.h"
+	#include "shader/shader.spv.frag.h"
+	#include "shader/GUIShader.spv.vert.h"
+	#include "shader/GUIShader.spv.frag.h"
+	#include "shader/TextShader.spv.vert.h"
+	#include "shader/TextShader.spv.frag.h"
+	#include "shader/CullShader.spv.comp.h"
+	#include "shader/DepthReductionShader.spv.comp.h"
+}
\ No newline at end of file
@@ -0,0 +1,452 @@
+#include "StagingRing.hpp"
+
+namespace pd
+{
+	void StagingRing::Initialize ( Dependencies const & deps, vk::DeviceSize partitionSize, uint32_t partitionCount )
+	{
+		this->deps = deps;
+		this->partitionSize = partitionSize;
+
+		auto size { partitionSize * partitionCount };
+
+		mappedData = static_cast < std::byte * > (
+			CreateMappedBuffer ( deps.allocator, "StagingRing", BufferUsages::stagingBuffer, size, buffer, allocation ) );
+
+		commandPool = deps.device.createCommandPool ( { { vk::CommandPoolCreateFlagBits::eResetCommandBuffer }, deps.queues->transferQueueFamilyIndex } );
+
+		auto commandBuffers { deps.device.allocateCommandBuffers ( { commandPool, vk::CommandBufferLevel::ePrimary, partitionCount } ) };
+
+		partitions.resize ( partitionCount );
+
+		for ( int index { 0 }; auto & partition : partitions )
+		{
+			partition.commandBuffer = commandBuffers [ index ];
+			++index;
+		}
+
+		vk::SemaphoreTypeCreateInfo semaphoreTypeCreateInfo { vk::SemaphoreType::eTimeline, 0 };
+		semaphore = deps.device.createSemaphore ( { {}, &semaphoreTypeCreateInfo } );
+	}
+
+	void StagingRing::Shutdown ()
+	{
+		Wait ( submittedValue );
+
+		// Uploads still being recorded target resources their owners have already destroyed, drop them
+		if ( partitions [ currentPartition ].recording )
+			partitions [ currentPartition ].commandBuffer.end ();
+
+		for ( auto const & pending : pendingDestructions )
+			pending.destroy ();
+
+		pendingDestructions.clear ();
+		partitions.clear ();
+
+		deps.device.destroy ( semaphore );
+		deps.device.destroy ( commandPool );
+
+		DestroyBuffer ( deps.allocator, buffer, allocation );
+	}
+
+	UploadTicket StagingRing::UpdateBuffer ( vk::Buffer dstBuffer, void const * data, vk::DeviceSize size, vk::DeviceSize offset )
+	{
+		auto staging { Stage ( data, size, alignment ) };
+
+		vk::BufferCopy copyRegion { staging.offset, offset, size };
+		staging.commandBuffer.copyBuffer ( staging.buffer, dstBuffer, { copyRegion } );
+
+		return partitions [ currentPartition ].value;
+	}
+
+	UploadTicket StagingRing::UploadImage ( vk::Image image, void const * data, vk::Extent2D extent, unsigned int components,
+		vk::Offset2D offset, vk::ImageLayout oldLayout )
+	{
+		auto size { static_cast < vk::DeviceSize > ( extent.width ) * extent.height * components };
+
+		// Buffer to image copies need an offset that is a multiple of both 4 and the texel size
+		auto staging { Stage ( data, size, alignment * components ) };
+
+		vk::ImageSubresourceRange subresourceRange { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+
+		// Transition layout to transfer dst optimal
+		{
+			vk::ImageMemoryBarrier imageMemoryBarrier (
+				oldLayout == vk::ImageLayout::eUndefined ? vk::AccessFlagBits::eNone : vk::AccessFlagBits::eShaderRead,
+				vk::AccessFlagBits::eTransferWrite,
+				oldLayout, vk::ImageLayout::eTransferDstOptimal,
+				VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+				image, subresourceRange
+			);
+
+			staging.commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eAllCommands,
+				vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, { imageMemoryBarrier } );
+		}
+
+		// Copy
+		vk::BufferImageCopy copyRegion { staging.offset, 0, 0, { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+			{ offset.x, offset.y, 0 }, { extent.width, extent.height, 1 } };
+
+		staging.commandBuffer.copyBufferToImage ( staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, { copyRegion } );
+
+		// Transition layout to shader read only optimal
+		{
+			vk::ImageMemoryBarrier imageMemoryBarrier (
+				vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+				vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+				VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+				image, subresourceRange
+			);
+
+			staging.commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eTransfer,
+				vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlagBits::eByRegion, {}, {}, { imageMemoryBarrier } );
+		}
+
+		return partitions [ currentPartition ].value;
+	}
+
+	UploadTicket StagingRing::UploadImages ( std::vector <ImageUpload> const & uploads )
+	{
+		std::vector <PreparedImage> images;
+		images.reserve ( uploads.size () );
+
+		std::vector <std::size_t> downsampledImages;
+
+		for ( auto const & upload : uploads )
+		{
+			images.push_back ( PrepareImage ( upload ) );
+
+			if ( upload.mipLevels > 1 && ! images.back ().blitMips && ! GetBlockSize ( upload.format ) )
+				downsampledImages.push_back ( images.size () - 1 );
+		}
+
+		ParallelFor ( downsampledImages.size (), [ & ] ( std::size_t index ) {
+			auto & image { images [ downsampledImages [ index ] ] };
+			auto const & upload { image.upload };
+
+			image.mipChain.resize ( image.size );
+			std::memcpy ( image.mipChain.data (), upload.data, GetLevelSize ( upload.format, upload.extent ) );
+
+			for ( uint32_t level { 1 }; level < upload.mipLevels; ++level )
+			{
+				DownsampleImage ( image.mipChain.data () + image.levelOffsets [ level - 1 ], GetMipLevelExtent ( upload.extent, level - 1 ),
+					image.mipChain.data () + image.levelOffsets [ level ], GetMipLevelExtent ( upload.extent, level ), GetTexelSize ( upload.format ) );
+			}
+		} );
+
+		auto alignUp { [] ( vk::DeviceSize value, vk::DeviceSize alignment ) { return ( value + alignment - 1 ) / alignment * alignment; } };
+
+		std::size_t begin { 0 };
+
+		while ( begin < images.size () )
+		{
+			auto & partition { GetRecordingPartition () };
+
+			// Take as many images as the partition still has room for, Stage mustn't submit halfway through them
+			auto used { partition.used };
+			auto end { begin };
+
+			for ( ; end < images.size (); ++end )
+			{
+				auto const & image { images [ end ] };
+
+				// Staged in a buffer of its own
+				if ( image.size > partitionSize )
+					continue;
+
+				auto offset { alignUp ( used, image.stagingAlignment ) };
+
+				if ( offset + image.size > partitionSize )
+					break;
+
+				used = offset + image.size;
+			}
+
+			// Not even the next image fits beside what is already staged
+			if ( end == begin )
+			{
+				Submit ();
+				continue;
+			}
+
+			RecordImageUploads ( partition.commandBuffer, { images.data () + begin, end - begin } );
+			begin = end;
+		}
+
+		return partitions [ currentPartition ].value;
+	}
+
+	StagingRing::PreparedImage StagingRing::PrepareImage ( ImageUpload const & upload )
+	{
+		auto compressed { GetBlockSize ( upload.format ) != 0 };
+
+		PreparedImage image { upload, upload.mipLevels > 1 && ! compressed && CanBlitMips ( upload.format ) };
+
+		// Buffer to image copies need an offset that is a multiple of both 4 and the texel or block size
+		image.stagingAlignment = compressed ? alignment : alignment * GetTexelSize ( upload.format );
+
+		// Compressed levels come tightly packed, their block size keeps each one aligned
+		auto levelAlignment { compressed ? GetBlockSize ( upload.format ) : image.stagingAlignment };
+
+		auto stagedLevels { image.blitMips ? 1 : upload.mipLevels };
+		vk::DeviceSize size { 0 };
+
+		for ( uint32_t level { 0 }; level < stagedLevels; ++level )
+		{
+			size = ( size + levelAlignment - 1 ) / levelAlignment * levelAlignment;
+			image.levelOffsets.push_back ( size );
+			size += GetLevelSize ( upload.format, GetMipLevelExtent ( upload.extent, level ) );
+		}
+
+		image.size = size;
+
+		return image;
+	}
+
+	void StagingRing::RecordImageUploads ( vk::CommandBuffer commandBuffer, std::span <PreparedImage const> images )
+	{
+		std::vector <vk::ImageMemoryBarrier> barriers;
+
+		auto addBarrier { [ & ] ( PreparedImage const & image, uint32_t baseLevel, uint32_t levelCount,
+			vk::AccessFlags srcAccess, vk::AccessFlags dstAccess, vk::ImageLayout oldLayout, vk::ImageLayout newLayout ) {
+			barriers.push_back ( {
+				srcAccess, dstAccess, oldLayout, newLayout,
+				VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+				image.upload.image, { vk::ImageAspectFlagBits::eColor, baseLevel, levelCount, 0, 1 }
+			} );
+		} };
+
+		for ( auto const & image : images )
+		{
+			addBarrier ( image, 0, image.upload.mipLevels, vk::AccessFlagBits::eNone, vk::AccessFlagBits::eTransferWrite,
+				vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal );
+		}
+
+		commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eTopOfPipe,
+			vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, barriers );
+
+		uint32_t blitLevels { 1 };
+
+		for ( auto const & image : images )
+		{
+			auto data { image.mipChain.empty () ? image.upload.data : image.mipChain.data () };
+			auto staging { Stage ( data, image.size, image.stagingAlignment ) };
+
+			std::vector <vk::BufferImageCopy> copyRegions;
+
+			for ( uint32_t level { 0 }; level < image.levelOffsets.size (); ++level )
+			{
+				auto extent { GetMipLevelExtent ( image.upload.extent, level ) };
+
+				copyRegions.push_back ( { staging.offset + image.levelOffsets [ level ], 0, 0, { vk::ImageAspectFlagBits::eColor, level, 0, 1 },
+					{ 0, 0, 0 }, { extent.width, extent.height, 1 } } );
+			}
+
+			commandBuffer.copyBufferToImage ( staging.buffer, image.upload.image, vk::ImageLayout::eTransferDstOptimal, copyRegions );
+
+			if ( image.blitMips )
+				blitLevels = std::max ( blitLevels, image.upload.mipLevels );
+		}
+
+		// Each level is blitted from the one above once that is written, all images step down together.
+		// Blits need a graphics queue, which the transfer queue's family is (see CreateDevice)
+		for ( uint32_t level { 1 }; level < blitLevels; ++level )
+		{
+			barriers.clear ();
+
+			for ( auto const & image : images )
+			{
+				if ( image.blitMips && level < image.upload.mipLevels )
+				{
+					addBarrier ( image, level - 1, 1, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead,
+						vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal );
+				}
+			}
+
+			commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eTransfer,
+				vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, barriers );
+
+			for ( auto const & image : images )
+			{
+				if ( ! image.blitMips || level >= image.upload.mipLevels )
+					continue;
+
+				auto srcExtent { GetMipLevelExtent ( image.upload.extent, level - 1 ) };
+				auto dstExtent { GetMipLevelExtent ( image.upload.extent, level ) };
+
+				vk::ImageBlit blit {
+					{ vk::ImageAspectFlagBits::eColor, level - 1, 0, 1 },
+					std::array <vk::Offset3D, 2> { vk::Offset3D { 0, 0, 0 }, vk::Offset3D { static_cast < int32_t > ( srcExtent.width ), static_cast < int32_t > ( srcExtent.height ), 1 } },
+					{ vk::ImageAspectFlagBits::eColor, level, 0, 1 },
+					std::array <vk::Offset3D, 2> { vk::Offset3D { 0, 0, 0 }, vk::Offset3D { static_cast < int32_t > ( dstExtent.width ), static_cast < int32_t > ( dstExtent.height ), 1 } }
+				};
+
+				commandBuffer.blitImage ( image.upload.image, vk::ImageLayout::eTransferSrcOptimal,
+					image.upload.image, vk::ImageLayout::eTransferDstOptimal, { blit }, vk::Filter::eLinear );
+			}
+		}
+
+		barriers.clear ();
+
+		for ( auto const & image : images )
+		{
+			// Blitted images have every level but the last one in transfer src layout
+			auto lastLevel { image.upload.mipLevels - 1 };
+			auto writtenLevel { image.blitMips ? lastLevel : 0 };
+
+			if ( image.blitMips )
+			{
+				addBarrier ( image, 0, lastLevel, vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eShaderRead,
+					vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal );
+			}
+
+			addBarrier ( image, writtenLevel, image.upload.mipLevels - writtenLevel, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+				vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal );
+		}
+
+		commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {}, barriers );
+	}
+
+	bool StagingRing::CanBlitMips ( vk::Format format )
+	{
+		auto [ formatIt, inserted ] { blitFormats.try_emplace ( format, false ) };
+
+		if ( inserted )
+		{
+			vk::FormatFeatureFlags requiredFeatures { vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst
+				| vk::FormatFeatureFlagBits::eSampledImageFilterLinear };
+
+			formatIt->second = ( deps.physicalDevice.getFormatProperties ( format ).optimalTilingFeatures & requiredFeatures ) == requiredFeatures;
+		}
+
+		return formatIt->second;
+	}
+
+	void StagingRing::DeferDestruction ( std::function <void ()> destroy )
+	{
+		// Begin recording so the partition gets submitted, its value then also covers all earlier work on the queue
+		auto & partition { GetRecordingPartition () };
+		pendingDestructions.push_back ( { partition.value, std::move ( destroy ) } );
+	}
+
+	uint64_t StagingRing::Submit ()
+	{
+		CollectCompleted ();
+
+		auto & partition { partitions [ currentPartition ] };
+
+		if ( ! partition.recording )
+			return submittedValue;
+
+		vmaFlushAllocation ( deps.allocator, allocation, currentPartition * partitionSize, partition.used );
+
+		partition.commandBuffer.end ();
+
+		// Consumers wait on the semaphore, which also makes the uploaded data visible to them
+		pd::Submit ( deps.queues->transferQueue, { partition.commandBuffer }, {}, { semaphore }, {}, {}, { partition.value } );
+
+		submittedValue = partition.value;
+		partition.recording = false;
+		currentPartition = ( currentPartition + 1 ) % static_cast < uint32_t > ( partitions.size () );
+
+		return submittedValue;
+	}
+
+	bool StagingRing::IsComplete ( UploadTicket ticket ) const
+	{
+		return deps.device.getSemaphoreCounterValue ( semaphore ) >= ticket;
+	}
+
+	void StagingRing::Wait ( UploadTicket ticket )
+	{
+		if ( ticket > submittedValue )
+			Submit ();
+
+		vk::SemaphoreWaitInfo waitInfo { {}, 1, &semaphore, &ticket };
+		deps.device.waitSemaphores ( waitInfo, std::numeric_limits <uint64_t>::max () );
+	}
+
+	StagingRing::Staging StagingRing::Stage ( void const * data, vk::DeviceSize size, vk::DeviceSize alignment )
+	{
+		// Too large for a partition, stage it in a buffer of its own that lives until the upload completes
+		if ( size > partitionSize )
+		{
+			auto & partition { GetRecordingPartition () };
+
+			vk::Buffer stagingBuffer;
+			VmaAllocation stagingBufferAllocation;
+
+			auto stagingBufferData { CreateMappedBuffer ( deps.allocator, "StagingRing", BufferUsages::stagingBuffer,
+				size, stagingBuffer, stagingBufferAllocation ) };
+
+			std::memcpy ( stagingBufferData, data, size );
+			vmaFlushAllocation ( deps.allocator, stagingBufferAllocation, 0, VK_WHOLE_SIZE );
+
+			DeferDestruction ( [ allocator = deps.allocator, stagingBuffer, stagingBufferAllocation ] () {
+				DestroyBuffer ( allocator, stagingBuffer, stagingBufferAllocation );
+			} );
+
+			return { partition.commandBuffer, stagingBuffer, 0 };
+		}
+
+		auto alignUp { [ alignment ] ( vk::DeviceSize value ) { return ( value + alignment - 1 ) / alignment * alignment; } };
+
+		if ( partitions [ currentPartition ].recording && alignUp ( partitions [ currentPartition ].used ) + size > partitionSize )
+			Submit ();
+
+		auto & partition { GetRecordingPartition () };
+
+		auto partitionOffset { alignUp ( partition.used ) };
+		partition.used = partitionOffset + size;
+
+		auto stagingOffset { currentPartition * partitionSize + partitionOffset };
+		std::memcpy ( mappedData + stagingOffset, data, size );
+
+		return { partition.commandBuffer, buffer, stagingOffset };
+	}
+
+	StagingRing::Partition & StagingRing::GetRecordingPartition ()
+	{
+		auto & partition { partitions [ currentPartition ] };
+
+		if ( partition.recording )
+			return partition;
+
+		// Wait until the uploads submitted from this partition last time around are done
+		Wait ( partition.value );
+
+		partition.commandBuffer.reset ();
+		partition.commandBuffer.begin ( { vk::CommandBufferUsageFlagBits::eOneTimeSubmit } );
+
+		// The transfer queue shares its family with the graphics queue (see CreateDevice), so an execution
+		// dependency on everything submitted before keeps the copies from overwriting data still being read
+		partition.commandBuffer.pipelineBarrier ( vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+			{}, {}, {}, {} );
+
+		partition.used = 0;
+		partition.value = submittedValue + 1;
+		partition.recording = true;
+
+		return partition;
+	}
+
+	void StagingRing::CollectCompleted ()
+	{
+		if ( pendingDestructions.empty () )
+			return;
+
+		auto completedValue { deps.device.getSemaphoreCounterValue ( semaphore ) };
+
+		std::vector <PendingDestruction> stillPending;
+
+		for ( auto & pending : pendingDestructions )
+		{
+			if ( pending.value <= completedValue )
+				pending.destroy ();
+			else
+				stillPending.push_back ( std::move ( pending ) );
+		}
+
+		pendingDestructions = std::move ( stillPending );
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Core.hpp"
+
+/*
+	Persistently mapped staging memory split into one partition per frame.
+	Uploads are sub-allocated from the current partition and their copies are recorded
+	into that partition's transfer command buffer, which is submitted once per frame.
+	Completion is tracked on a timeline semaphore instead of blocking on fences.
+*/
+
+namespace pd
+{
+	class StagingRing
+	{
+	public:
+		struct Dependencies
+		{
+			vk::PhysicalDevice physicalDevice;
+			vk::Device device;
+			VmaAllocator allocator;
+			DeviceQueues const * queues;
+		};
+
+		void Initialize ( Dependencies const &, vk::DeviceSize partitionSize = 4 * 1024 * 1024, uint32_t partitionCount = 2 );
+		void Shutdown ();
+
+		UploadTicket UpdateBuffer ( vk::Buffer, void const * data, vk::DeviceSize size, vk::DeviceSize offset = 0 );
+
+		// Leaves the image in shader read only optimal layout
+		UploadTicket UploadImage ( vk::Image, void const * data, vk::Extent2D extent, unsigned int components,
+			vk::Offset2D offset = {}, vk::ImageLayout oldLayout = vk::ImageLayout::eUndefined );
+
+		struct ImageUpload
+		{
+			vk::Image image;
+			void const * data;
+			vk::Extent2D extent;
+			vk::Format format;
+
+			// Block compressed data holds every level back to back, largest first. Other data holds the first level
+			// and the rest are generated, blitted on the GPU where the format supports linear filtering and box
+			// filtered on the CPU otherwise
+			uint32_t mipLevels { 1 };
+		};
+
+		// Whole images in undefined layout, the images sharing a partition share their layout transitions
+		UploadTicket UploadImages ( std::vector <ImageUpload> const & );
+
+		// Runs once every upload recorded so far, and all work submitted before them, has completed
+		void DeferDestruction ( std::function <void ()> );
+
+		// Submits the uploads recorded since the last call and returns the timeline value they signal
+		uint64_t Submit ();
+
+		bool IsComplete ( UploadTicket ) const;
+		void Wait ( UploadTicket );
+
+		vk::Semaphore GetSemaphore () const;
+		uint64_t GetSubmittedValue () const;
+
+	private:
+		static inline constexpr vk::DeviceSize alignment { 16 };
+
+		struct Partition
+		{
+			vk::CommandBuffer commandBuffer;
+			uint64_t value { 0 };
+			vk::DeviceSize used { 0 };
+			bool recording { false };
+		};
+
+		struct Staging
+		{
+			vk::CommandBuffer commandBuffer;
+			vk::Buffer buffer;
+			vk::DeviceSize offset;
+		};
+
+		struct PendingDestruction
+		{
+			uint64_t value;
+			std::function <void ()> destroy;
+		};
+
+		struct PreparedImage
+		{
+			ImageUpload upload;
+			bool blitMips;
+
+			// Where each level copied from the staging buffer starts, relative to the first
+			std::vector <vk::DeviceSize> levelOffsets;
+			vk::DeviceSize size;
+			vk::DeviceSize stagingAlignment;
+
+			// Every level, when they are downsampled on the CPU
+			std::vector <unsigned char> mipChain;
+		};
+
+		Staging Stage ( void const * data, vk::DeviceSize size, vk::DeviceSize alignment );
+		PreparedImage PrepareImage ( ImageUpload const & );
+		void RecordImageUploads ( vk::CommandBuffer, std::span <PreparedImage const> );
+		bool CanBlitMips ( vk::Format );
+		Partition & GetRecordingPartition ();
+		void CollectCompleted ();
+
+		Dependencies deps;
+
+		vk::DeviceSize partitionSize;
+		vk::Buffer buffer;
+		VmaAllocation allocation;
+		std::byte * mappedData;
+
+		vk::CommandPool commandPool;
+		std::vector <Partition> partitions;
+		uint32_t currentPartition { 0 };
+
+		vk::Semaphore semaphore;
+		uint64_t submittedValue { 0 };
+
+		std::vector <PendingDestruction> pendingDestructions;
+
+		std::unordered_map < vk::Format, bool > blitFormats;
+	};
+
+
+
+	// Implementation
+	inline vk::Semaphore StagingRing::GetSemaphore () const { return semaphore; }
+	inline uint64_t StagingRing::GetSubmittedValue () const { return submittedValue; }
+}
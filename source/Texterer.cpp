@@ -1,4 +1,5 @@
 #include "Texterer.hpp"
+#include "Shaders.hpp"
 
 namespace pd
 {
@@ -14,7 +15,7 @@ namespace pd
 
 		globalDescriptorSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
 			// Camera
-			{ 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+			{ 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex },
 			} );
 
 		instanceDescriptorSetLayout = CreateDescriptorSetLayout ( deps.device, {}, {
@@ -27,15 +28,24 @@ namespace pd
 		globalDescriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, globalDescriptorSetLayout );
 
 		pipelineLayout = CreatePipelineLayout ();
-		pipeline = CreatePipeline ();
-
-		textIDManager = { 0, maxInstances - 1 };
+		deps.pipelineCache->Compile ( pipeline, [ this ] () { return CreatePipeline (); } );
 
 		CreateGeometryBuffers ();
 
+		glyphAtlas.Initialize ( { deps.device, deps.allocator, deps.stagingRing } );
+		frameInstanceBuffers.resize ( deps.framesInFlight );
+
 		// Create camera buffer
-		CreateBuffer ( deps.physicalDevice, deps.device, BufferUsages::uniformBuffer, sizeof ( CameraData ),
-			cameraUniformBuffer, cameraUniformBufferMemory );
+		cameraUniformBufferStride = GetUniformBufferStride ( deps.physicalDevice, sizeof ( CameraData ) );
+
+		cameraUniformBufferData = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Texterer", BufferUsages::uniformBuffer,
+			cameraUniformBufferStride * deps.framesInFlight, cameraUniformBuffer, cameraUniformBufferAllocation ) );
+
+		{
+			vk::DescriptorBufferInfo bufferInfo { cameraUniformBuffer, 0, sizeof ( CameraData ) };
+			vk::WriteDescriptorSet write { globalDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &bufferInfo };
+			deps.device.updateDescriptorSets ( { write }, {} );
+		}
 
 		SetViewportSize ( { 1280, 720 } );
 	}
@@ -45,19 +55,24 @@ namespace pd
 		for ( auto & [id, textData] : textDatas )
 			DestroyGlyphs ( textData.glyphDatas );
 
+		for ( auto const & descriptorSet : pageDescriptorSets )
+			deps.device.free ( descriptorPool, descriptorSet );
+
+		glyphAtlas.Shutdown ();
+
+		for ( auto const & frameInstanceBuffer : frameInstanceBuffers )
+			DestroyBuffer ( deps.allocator, frameInstanceBuffer.buffer, frameInstanceBuffer.allocation );
+
 		deps.device.free ( descriptorPool, globalDescriptorSet );
 
 		deps.device.destroy ( globalDescriptorSetLayout );
 		deps.device.destroy ( instanceDescriptorSetLayout );
 
-		deps.device.destroy ( cameraUniformBuffer );
-		deps.device.free ( cameraUniformBufferMemory );
+		DestroyBuffer ( deps.allocator, cameraUniformBuffer, cameraUniformBufferAllocation );
 
-		deps.device.destroy ( vertexBuffer );
-		deps.device.free ( vertexBufferMemory );
+		DestroyBuffer ( deps.allocator, vertexBuffer, vertexBufferAllocation );
 
-		deps.device.destroy ( indexBuffer );
-		deps.device.free ( indexBufferMemory );
+		DestroyBuffer ( deps.allocator, indexBuffer, indexBufferAllocation );
 
 		deps.device.destroy ( pipeline );
 		deps.device.destroy ( pipelineLayout );
@@ -68,43 +83,43 @@ namespace pd
 		//FT_Done_FreeType ( ftLibrary );
 	}
 
-	void Texterer::RecordRender ( vk::CommandBuffer commandBuffer, vk::Extent2D viewportExtent )
+	void Texterer::RecordRender ( vk::CommandBuffer commandBuffer, vk::Extent2D viewportExtent, uint32_t frameIndex )
 	{
+		// The GPU is done with this frame's copy, the caller waited for its fence
+		auto cameraOffset { cameraUniformBufferStride * frameIndex };
+		std::memcpy ( cameraUniformBufferData + cameraOffset, &cameraData, sizeof ( CameraData ) );
+		vmaFlushAllocation ( deps.allocator, cameraUniformBufferAllocation, cameraOffset, sizeof ( CameraData ) );
+
+		if ( instancesDirty )
+			BuildInstances ();
+
+		if ( instances.empty () )
+			return;
+
+		auto & frameInstanceBuffer { frameInstanceBuffers [ frameIndex ] };
+		UpdateFrameInstanceBuffer ( frameInstanceBuffer );
+
 		commandBuffer.bindPipeline ( vk::PipelineBindPoint::eGraphics, pipeline );
 
 		pd::SetViewport ( commandBuffer, viewportExtent );
 
-		commandBuffer.bindVertexBuffers ( 0, { vertexBuffer }, { 0 } );
+		commandBuffer.bindVertexBuffers ( 0, { vertexBuffer, frameInstanceBuffer.buffer }, { 0, 0 } );
 		commandBuffer.bindIndexBuffer ( indexBuffer, 0, vk::IndexType::eUint32 );
 
 		// Bind global descriptor set
-		commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { globalDescriptorSet }, {} );
+		commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { globalDescriptorSet },
+			{ static_cast < uint32_t > ( cameraOffset ) } );
 
-		for ( auto const & [id, textData] : textDatas )
+		for ( auto const & pageDraw : pageDraws )
 		{
-			commandBuffer.pushConstants ( pipelineLayout, vk::ShaderStageFlagBits::eFragment, 64, 16, glm::value_ptr ( textData.color ) );
-
-			for ( auto const & glyphData : textData.glyphDatas )
-			{
-				commandBuffer.pushConstants ( pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, 64, glm::value_ptr ( glyphData.transform ) );
-
-				commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, { glyphData.descriptorSet }, {} );
-
-				commandBuffer.drawIndexed ( 6, 1, 0, 0, 0 );
-			}
+			commandBuffer.bindDescriptorSets ( vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, { pageDescriptorSets [ pageDraw.page ] }, {} );
+			commandBuffer.drawIndexed ( 6, pageDraw.instanceCount, 0, 0, pageDraw.firstInstance );
 		}
 	}
 
 	void Texterer::SetViewportSize ( glm::vec2 const & size )
 	{
-		CameraData cameraData { glm::ortho ( 0.0f, size.x, size.y, 0.0f ) };
-
-		UpdateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool,
-			deps.queues->transferQueue, cameraUniformBuffer, &cameraData, sizeof ( CameraData ) );
-
-		vk::DescriptorBufferInfo bufferInfo { cameraUniformBuffer, 0, sizeof ( CameraData ) };
-		vk::WriteDescriptorSet write { globalDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &bufferInfo };
-		deps.device.updateDescriptorSets ( { write }, {} );
+		cameraData = { glm::ortho ( 0.0f, size.x, size.y, 0.0f ) };
 	}
 
 	int Texterer::CreateText ()
@@ -147,34 +162,23 @@ namespace pd
 	{
 		auto & textData { textDatas.at ( id ) };
 		textData.position = position;
-		//LoadGlyphs ( textData );
-
-		for ( auto & glyphData : textData.glyphDatas )
-		{
-			glm::mat4 glyphTranslationMat { glm::translate ( glm::identity <glm::mat4> (), { textData.position + glyphData.position, 0.0f } ) };
-			glm::mat4 glyphScaleMat { glm::scale ( glm::identity <glm::mat4> (), { glyphData.scale, 1.0f } ) };
-
-			glyphData.transform = glyphTranslationMat * glyphScaleMat;
-		}
+		instancesDirty = true;
 	}
 
 	void Texterer::SetTextColor ( int id, glm::vec4 const & color )
 	{
 		auto & textData { textDatas.at ( id ) };
 		textData.color = color;
+		instancesDirty = true;
 	}
 
 	void Texterer::DestroyGlyphs ( std::vector <GlyphData> & glyphDatas )
 	{
 		for ( auto const & glyphData : glyphDatas )
-		{
-			deps.device.destroy ( glyphData.texture );
-			deps.device.destroy ( glyphData.textureView );
-			deps.device.free ( glyphData.textureMemory );
-			deps.device.free ( descriptorPool, glyphData.descriptorSet );
-		}
+			glyphAtlas.Release ( glyphData.key );
 
 		glyphDatas.clear ();
+		instancesDirty = true;
 	}
 
 	glm::vec2 Texterer::GetTextSize ( int id )
@@ -188,62 +192,120 @@ namespace pd
 		DestroyGlyphs ( textData.glyphDatas );
 
 		if ( textData.text.empty () || textData.font.empty () )
+		{
+			textData.face.reset ();
 			return;
+		}
 
-		bt::Face face { btLibrary, textData.font };
-		bt::Text text { face, textData.text, static_cast <int> ( textData.height ) };
+		textData.face = btLibrary.GetFace ( textData.font );
+		bt::Text text { *textData.face, textData.text, static_cast <int> ( textData.height ) };
 
 		textData.size = text.GetSize ();
 
+		auto pixelHeight { static_cast <int> ( textData.height ) };
+
 		for ( auto const & glyph : text.GetGlyphs () )
 		{
-			if ( glyph.bitmap.buffer )
-			{
-				GlyphData glyphData {};
+			GlyphAtlas::Key key { textData.font, pixelHeight, glyph.index };
+
+			// Only rasterised and uploaded the first time any text uses it
+			auto atlasGlyph { glyphAtlas.Acquire ( *textData.face, key ) };
 
-				glyphData.position = glyph.position;
-				glyphData.scale = glyph.size;
+			if ( ! atlasGlyph )
+				continue;
 
-				glm::mat4 glyphTranslationMat { glm::translate ( glm::identity <glm::mat4> (), { textData.position + glyph.position, 0.0f } ) };
-				glm::mat4 glyphScaleMat { glm::scale ( glm::identity <glm::mat4> (), { glyph.size, 1.0f } ) };
+			GlyphData glyphData { key, atlasGlyph->page, atlasGlyph->uvRect };
 
-				glyphData.transform = glyphTranslationMat * glyphScaleMat;
+			glyphData.position = glyph.position;
+			glyphData.scale = glyph.size;
 
-				CreateTexture ( deps.physicalDevice, deps.device, deps.transferCommandPool,
-					deps.queues->transferQueue, deps.queues->transferQueueFamilyIndex,
-					glyph.bitmap.buffer, { glyph.bitmap.width, static_cast < uint32_t > ( glyph.bitmap.rows ) },
-					1,
-					glyphData.texture, glyphData.textureView, glyphData.textureMemory );
+			textData.glyphDatas.push_back ( glyphData );
+		}
+
+		AllocatePageDescriptorSets ();
+	}
 
-				glyphData.descriptorSet = AllocateDescriptorSet ( deps.device, descriptorPool, instanceDescriptorSetLayout );
+	void Texterer::AllocatePageDescriptorSets ()
+	{
+		while ( pageDescriptorSets.size () < glyphAtlas.GetPageCount () )
+		{
+			auto descriptorSet { AllocateDescriptorSet ( deps.device, descriptorPool, instanceDescriptorSetLayout ) };
 
-				vk::DescriptorImageInfo imageInfo { {}, glyphData.textureView, vk::ImageLayout::eShaderReadOnlyOptimal };
+			vk::DescriptorImageInfo imageInfo { {}, glyphAtlas.GetPageView ( static_cast < uint32_t > ( pageDescriptorSets.size () ) ),
+				vk::ImageLayout::eShaderReadOnlyOptimal };
 
-				std::vector <vk::WriteDescriptorSet> writes {
-					{ glyphData.descriptorSet, 1, 0, 1, vk::DescriptorType::eSampledImage, &imageInfo, {} },
-				};
+			std::vector <vk::WriteDescriptorSet> writes {
+				{ descriptorSet, 1, 0, 1, vk::DescriptorType::eSampledImage, &imageInfo, {} },
+			};
 
-				deps.device.updateDescriptorSets ( writes, {} );
+			deps.device.updateDescriptorSets ( writes, {} );
 
-				textData.glyphDatas.push_back ( glyphData );
+			pageDescriptorSets.push_back ( descriptorSet );
+		}
+	}
+
+	void Texterer::BuildInstances ()
+	{
+		// Group the glyphs by atlas page so each page takes one draw
+		std::vector < std::vector <GlyphInstance> > pageInstances ( glyphAtlas.GetPageCount () );
+
+		for ( auto const & [ id, textData ] : textDatas )
+		{
+			for ( auto const & glyphData : textData.glyphDatas )
+			{
+				pageInstances [ glyphData.page ].push_back ( {
+					textData.position + glyphData.position, glyphData.scale, glyphData.uvRect, textData.color
+				} );
 			}
 		}
+
+		instances.clear ();
+		pageDraws.clear ();
+
+		for ( uint32_t page { 0 }; page < pageInstances.size (); ++page )
+		{
+			if ( pageInstances [ page ].empty () )
+				continue;
+
+			pageDraws.push_back ( { page, static_cast < uint32_t > ( instances.size () ), static_cast < uint32_t > ( pageInstances [ page ].size () ) } );
+			instances.insert ( instances.end (), pageInstances [ page ].begin (), pageInstances [ page ].end () );
+		}
+
+		instancesDirty = false;
+		++instancesVersion;
 	}
 
-	vk::PipelineLayout Texterer::CreatePipelineLayout ()
+	void Texterer::UpdateFrameInstanceBuffer ( FrameInstanceBuffer & frameInstanceBuffer )
 	{
-		std::vector <vk::PushConstantRange> pushConstantRanges {
-			{ vk::ShaderStageFlagBits::eVertex, 0, 64 }, // Transformation matrix
-			{ vk::ShaderStageFlagBits::eFragment, 64, 16 }, // Color
-		};
+		if ( frameInstanceBuffer.version == instancesVersion )
+			return;
+
+		// The caller waited for this frame's fence, so the GPU is no longer reading the buffer
+		if ( frameInstanceBuffer.capacity < instances.size () )
+		{
+			DestroyBuffer ( deps.allocator, frameInstanceBuffer.buffer, frameInstanceBuffer.allocation );
+
+			frameInstanceBuffer.capacity = std::max <size_t> ( instances.size (), frameInstanceBuffer.capacity * 2 );
 
-		return pd::CreatePipelineLayout ( deps.device, { globalDescriptorSetLayout, instanceDescriptorSetLayout }, pushConstantRanges );
+			frameInstanceBuffer.data = static_cast < std::byte * > ( CreateMappedBuffer ( deps.allocator, "Texterer", BufferUsages::vertexBuffer,
+				frameInstanceBuffer.capacity * sizeof ( GlyphInstance ), frameInstanceBuffer.buffer, frameInstanceBuffer.allocation ) );
+		}
+
+		std::memcpy ( frameInstanceBuffer.data, instances.data (), instances.size () * sizeof ( GlyphInstance ) );
+		vmaFlushAllocation ( deps.allocator, frameInstanceBuffer.allocation, 0, instances.size () * sizeof ( GlyphInstance ) );
+
+		frameInstanceBuffer.version = instancesVersion;
+	}
+
+	vk::PipelineLayout Texterer::CreatePipelineLayout ()
+	{
+		return pd::CreatePipelineLayout ( deps.device, { globalDescriptorSetLayout, instanceDescriptorSetLayout } );
 	}
 
 	vk::Pipeline Texterer::CreatePipeline ()
 	{
-		vk::ShaderModule vertexShader { CreateShaderModuleFromFile ( deps.device, "shader/build/TextShader.spv.vert" ) };
-		vk::ShaderModule fragmentShader { CreateShaderModuleFromFile ( deps.device, "shader/build/TextShader.spv.frag" ) };
+		vk::ShaderModule vertexShader { CreateShaderModule ( deps.device, shader::textVertexShader ) };
+		vk::ShaderModule fragmentShader { CreateShaderModule ( deps.device, shader::textFragmentShader ) };
 
 		std::vector <vk::PipelineShaderStageCreateInfo> shaderStages
 		{
@@ -251,11 +313,18 @@ namespace pd
 			{ {}, vk::ShaderStageFlagBits::eFragment, fragmentShader, "main" }
 		};
 
-		std::vector <vk::VertexInputBindingDescription> vertexBindings { { 0, sizeof ( float ) * ( 2 + 2 ), vk::VertexInputRate::eVertex } };
+		std::vector <vk::VertexInputBindingDescription> vertexBindings {
+			{ 0, sizeof ( float ) * ( 2 + 2 ), vk::VertexInputRate::eVertex },
+			{ 1, sizeof ( GlyphInstance ), vk::VertexInputRate::eInstance }
+		};
 
 		std::vector <vk::VertexInputAttributeDescription> vertexAttributes {
 			{ 0, 0, vk::Format::eR32G32Sfloat, 0 },
-			{ 1, 0, vk::Format::eR32G32Sfloat, sizeof ( float ) * 2 }
+			{ 1, 0, vk::Format::eR32G32Sfloat, sizeof ( float ) * 2 },
+			{ 2, 1, vk::Format::eR32G32Sfloat, offsetof ( GlyphInstance, position ) },
+			{ 3, 1, vk::Format::eR32G32Sfloat, offsetof ( GlyphInstance, size ) },
+			{ 4, 1, vk::Format::eR32G32B32A32Sfloat, offsetof ( GlyphInstance, uvRect ) },
+			{ 5, 1, vk::Format::eR32G32B32A32Sfloat, offsetof ( GlyphInstance, color ) }
 		};
 
 		vk::PipelineVertexInputStateCreateInfo vertexInputState
@@ -344,7 +413,7 @@ namespace pd
 			0,
 		};
 
-		auto pipeline { deps.device.createGraphicsPipeline ( {}, createInfo ).value };
+		auto pipeline { deps.device.createGraphicsPipeline ( deps.pipelineCache->Get (), createInfo ).value };
 
 		deps.device.destroy ( vertexShader );
 		deps.device.destroy ( fragmentShader );
@@ -363,10 +432,10 @@ namespace pd
 
 		std::vector <uint32_t> indices { 0, 1, 2, 2, 3, 0 };
 
-		CreateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue, BufferUsages::vertexBuffer,
-			vertices.data (), vertices.size () * sizeof ( float ), vertexBuffer, vertexBufferMemory );
+		CreateBuffer ( deps.allocator, "Texterer", *deps.stagingRing, BufferUsages::vertexBuffer,
+			vertices.data (), vertices.size () * sizeof ( float ), vertexBuffer, vertexBufferAllocation );
 
-		CreateBuffer ( deps.physicalDevice, deps.device, deps.transferCommandPool, deps.queues->transferQueue, BufferUsages::indexBuffer,
-			indices.data (), indices.size () * sizeof ( uint32_t ), indexBuffer, indexBufferMemory );
+		CreateBuffer ( deps.allocator, "Texterer", *deps.stagingRing, BufferUsages::indexBuffer,
+			indices.data (), indices.size () * sizeof ( uint32_t ), indexBuffer, indexBufferAllocation );
 	}
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "Core.hpp"
+#include "StagingRing.hpp"
+#include "PipelineCache.hpp"
 #include "IDManager.hpp"
 
 #include <freetype/freetype.h>
 #include "BetterType.hpp"
+#include "GlyphAtlas.hpp"
 
 namespace pd
 {
@@ -15,15 +18,18 @@ namespace pd
 		{
 			vk::PhysicalDevice physicalDevice;
 			vk::Device device;
+			VmaAllocator allocator;
 			DeviceQueues const * queues;
 			vk::RenderPass renderPass;
-			vk::CommandPool transferCommandPool;
+			StagingRing * stagingRing;
+			uint32_t framesInFlight;
+			PipelineCache * pipelineCache;
 		};
 
 		void Initialize ( Dependencies const & );
 		void Shutdown ();
 
-		void RecordRender ( vk::CommandBuffer, vk::Extent2D viewportExtent );
+		void RecordRender ( vk::CommandBuffer, vk::Extent2D viewportExtent, uint32_t frameIndex );
 		
 		void SetViewportSize ( glm::vec2 const & size );
 
@@ -38,8 +44,6 @@ namespace pd
 		glm::vec2 GetTextSize ( int id );
 
 	private:
-		static inline constexpr int maxInstances { 10000 };
-
 		//struct Batch
 		//{
 		//	std::string font;
@@ -48,18 +52,40 @@ namespace pd
 
 		struct GlyphData
 		{
-			// Texture
-			vk::Image texture;
-			vk::DeviceMemory textureMemory;
-			vk::ImageView textureView;
-
-			vk::DescriptorSet descriptorSet;
+			GlyphAtlas::Key key;
+			uint32_t page;
+			glm::vec4 uvRect;
 
 			// Position of this glyph relative the string it is in
 			glm::vec2 position;
 
 			glm::vec2 scale;
-			glm::mat4 transform;
+		};
+
+		// Per instance vertex data, see TextShader.glsl.vert
+		struct GlyphInstance
+		{
+			glm::vec2 position;
+			glm::vec2 size;
+			glm::vec4 uvRect;
+			glm::vec4 color;
+		};
+
+		// Instances of one atlas page, drawn with a single call
+		struct PageDraw
+		{
+			uint32_t page;
+			uint32_t firstInstance;
+			uint32_t instanceCount;
+		};
+
+		struct FrameInstanceBuffer
+		{
+			vk::Buffer buffer {};
+			VmaAllocation allocation {};
+			std::byte * data { nullptr };
+			size_t capacity { 0 };
+			uint64_t version { 0 };
 		};
 
 		struct TextData
@@ -70,6 +96,8 @@ namespace pd
 			glm::vec4 color		{ 1.0f, 1.0f, 1.0f, 1.0f };
 			glm::vec2 position	{ 0.0f, 0.0f };
 
+			// Keeps the font open while any text uses it
+			std::shared_ptr <bt::Face> face;
 			std::vector <GlyphData> glyphDatas;
 
 			glm::vec2 size;
@@ -82,6 +110,9 @@ namespace pd
 
 		void DestroyGlyphs ( std::vector <GlyphData> & );
 		void LoadGlyphs ( TextData & );
+		void AllocatePageDescriptorSets ();
+		void BuildInstances ();
+		void UpdateFrameInstanceBuffer ( FrameInstanceBuffer & );
 		vk::PipelineLayout CreatePipelineLayout ();
 		vk::Pipeline CreatePipeline ();
 		void CreateGeometryBuffers ();
@@ -102,14 +133,28 @@ namespace pd
 		vk::Pipeline pipeline;
 
 		vk::Buffer vertexBuffer;
-		vk::DeviceMemory vertexBufferMemory;
+		VmaAllocation vertexBufferAllocation;
 		vk::Buffer indexBuffer;
-		vk::DeviceMemory indexBufferMemory;
+		VmaAllocation indexBufferAllocation;
 		
+		// One copy per frame in flight, selected with a dynamic offset
+		CameraData cameraData;
 		vk::Buffer cameraUniformBuffer;
-		vk::DeviceMemory cameraUniformBufferMemory;
+		VmaAllocation cameraUniformBufferAllocation;
+		std::byte * cameraUniformBufferData;
+		vk::DeviceSize cameraUniformBufferStride;
 
 		vk::DescriptorSet globalDescriptorSet;
+
+		GlyphAtlas glyphAtlas;
+		std::vector <vk::DescriptorSet> pageDescriptorSets;
+
+		// Rebuilt when a text changes, then copied into each frame's buffer once
+		std::vector <GlyphInstance> instances;
+		std::vector <PageDraw> pageDraws;
+		bool instancesDirty { false };
+		uint64_t instancesVersion { 0 };
+		std::vector <FrameInstanceBuffer> frameInstanceBuffers;
 		
 		IDManager textIDManager;
 
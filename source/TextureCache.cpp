@@ -0,0 +1,167 @@
+#include "TextureCache.hpp"
+
+namespace pd
+{
+	void TextureCache::Initialize ( Dependencies const & deps )
+	{
+		this->deps = deps;
+	}
+
+	void TextureCache::Shutdown ()
+	{
+		for ( auto const & [ handle, entry ] : entries )
+		{
+			deps.stagingRing->DeferDestruction ( [ device = deps.device, allocator = deps.allocator, entry ] () {
+				device.destroy ( entry.view );
+				DestroyImage ( allocator, entry.image, entry.allocation );
+			} );
+		}
+
+		entries.clear ();
+		pathHandles.clear ();
+		contentHandles.clear ();
+	}
+
+	TextureCache::Handle TextureCache::Acquire ( std::filesystem::path const & path )
+	{
+		return Acquire ( std::vector { path } ).front ();
+	}
+
+	std::vector <TextureCache::Handle> TextureCache::Acquire ( std::vector <std::filesystem::path> const & paths )
+	{
+		struct Load
+		{
+			std::string path;
+			TextureFile file;
+			Handle handle;
+		};
+
+		std::vector <Handle> handles ( paths.size () );
+		std::vector <Load> loads;
+
+		// Paths not seen before, each read once however often it is listed
+		std::unordered_map < std::string, std::size_t > loadIndices;
+		std::vector < std::optional <std::size_t> > pathLoads ( paths.size () );
+
+		for ( std::size_t index { 0 }; index < paths.size (); ++index )
+		{
+			auto canonicalPath { std::filesystem::weakly_canonical ( paths [ index ] ).generic_string () };
+
+			if ( auto pathIt { pathHandles.find ( canonicalPath ) }; pathIt != pathHandles.end () )
+			{
+				++entries.at ( pathIt->second ).referenceCount;
+				handles [ index ] = pathIt->second;
+				continue;
+			}
+
+			auto [ loadIt, inserted ] { loadIndices.try_emplace ( canonicalPath, loads.size () ) };
+
+			if ( inserted )
+				loads.push_back ( { canonicalPath } );
+
+			pathLoads [ index ] = loadIt->second;
+		}
+
+		stbi_set_flip_vertically_on_load ( 1 );
+
+		// Reading and decoding or transcoding dominate, the files are independent of each other
+		ParallelFor ( loads.size (), [ & ] ( std::size_t index ) {
+			loads [ index ].file = LoadTextureFile ( deps.physicalDevice, loads [ index ].path );
+		} );
+
+		std::vector <StagingRing::ImageUpload> uploads;
+
+		for ( auto & load : loads )
+			load.handle = Insert ( load.path, load.file, uploads );
+
+		// Recorded together so the images share their layout transitions, the staging ring copies the data
+		deps.stagingRing->UploadImages ( uploads );
+
+		for ( std::size_t index { 0 }; index < paths.size (); ++index )
+		{
+			if ( ! pathLoads [ index ] )
+				continue;
+
+			handles [ index ] = loads [ *pathLoads [ index ] ].handle;
+			++entries.at ( handles [ index ] ).referenceCount;
+		}
+
+		return handles;
+	}
+
+	std::optional <TextureCache::Handle> TextureCache::TryAcquire ( std::filesystem::path const & path )
+	{
+		auto pathIt { pathHandles.find ( std::filesystem::weakly_canonical ( path ).generic_string () ) };
+
+		if ( pathIt == pathHandles.end () )
+			return {};
+
+		++entries.at ( pathIt->second ).referenceCount;
+		return pathIt->second;
+	}
+
+	TextureCache::Handle TextureCache::Acquire ( std::filesystem::path const & path, TextureFile const & file )
+	{
+		if ( auto handle { TryAcquire ( path ) } )
+			return *handle;
+
+		std::vector <StagingRing::ImageUpload> uploads;
+		auto handle { Insert ( std::filesystem::weakly_canonical ( path ).generic_string (), file, uploads ) };
+
+		if ( ! uploads.empty () )
+			deps.stagingRing->UploadImages ( uploads );
+
+		++entries.at ( handle ).referenceCount;
+		return handle;
+	}
+
+	TextureCache::Handle TextureCache::Insert ( std::string const & canonicalPath, TextureFile const & file, std::vector <StagingRing::ImageUpload> & uploads )
+	{
+		ContentKey contentKey { file.hash, file.size };
+
+		// Another path already loaded the same image
+		if ( auto contentIt { contentHandles.find ( contentKey ) }; contentIt != contentHandles.end () )
+		{
+			pathHandles [ canonicalPath ] = contentIt->second;
+			return contentIt->second;
+		}
+
+		std::cout << "Creating texture: " << canonicalPath << std::endl;
+
+		Entry entry;
+		entry.contentKey = contentKey;
+		CreateTextureImage ( deps.device, deps.allocator, "TextureCache", file.extent, file.format, file.mipLevels, entry.image, entry.view, entry.allocation );
+
+		auto handle { nextHandle++ };
+
+		entries.insert ( { handle, entry } );
+		contentHandles.insert ( { contentKey, handle } );
+		pathHandles [ canonicalPath ] = handle;
+
+		uploads.push_back ( { entry.image, file.data, file.extent, file.format, file.mipLevels } );
+		return handle;
+	}
+
+	void TextureCache::Release ( Handle handle )
+	{
+		auto entryIt { entries.find ( handle ) };
+
+		if ( entryIt == entries.end () )
+			throw std::runtime_error { "Released a texture that isn't loaded" };
+
+		if ( --entryIt->second.referenceCount > 0 )
+			return;
+
+		// Frames still in flight may be sampling it
+		deps.stagingRing->DeferDestruction ( [ device = deps.device, allocator = deps.allocator, entry = entryIt->second ] () {
+			device.destroy ( entry.view );
+			DestroyImage ( allocator, entry.image, entry.allocation );
+		} );
+
+		contentHandles.erase ( entryIt->second.contentKey );
+		entries.erase ( entryIt );
+
+		// Forget its paths too, so a file changed on disk while unused is read again on its next load
+		std::erase_if ( pathHandles, [ handle ] ( auto const & pathHandle ) { return pathHandle.second == handle; } );
+	}
+}
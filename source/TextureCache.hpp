@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Core.hpp"
+#include "StagingRing.hpp"
+#include "TextureFile.hpp"
+
+/*
+	Textures loaded from files, shared by every subsystem that samples them.
+	Files are identified by the hash and size of their contents, so the same image reached
+	through different paths, or used by many meshes, is decoded and uploaded once.
+	A texture is released once the last handle to it is.
+*/
+
+namespace pd
+{
+	class TextureCache
+	{
+	public:
+		struct Dependencies
+		{
+			vk::PhysicalDevice physicalDevice;
+			vk::Device device;
+			VmaAllocator allocator;
+			StagingRing * stagingRing;
+		};
+
+		using Handle = std::size_t;
+
+		void Initialize ( Dependencies const & );
+		void Shutdown ();
+
+		// Every acquired handle must be released
+		Handle Acquire ( std::filesystem::path const & );
+
+		// Reads and decodes or transcodes the files not loaded yet in parallel, handles are in the order of the paths
+		std::vector <Handle> Acquire ( std::vector <std::filesystem::path> const & );
+
+		// Only acquires a texture some path already loaded, without reading the file
+		std::optional <Handle> TryAcquire ( std::filesystem::path const & );
+
+		// Creates the texture from a file read elsewhere, on a loader thread, unless its path or contents are loaded already
+		Handle Acquire ( std::filesystem::path const &, TextureFile const & );
+
+		void Release ( Handle );
+
+		vk::ImageView GetView ( Handle ) const;
+
+	private:
+		// The size tells apart files whose hashes collide
+		struct ContentKey
+		{
+			std::size_t hash;
+			std::size_t size;
+
+			bool operator == ( ContentKey const & ) const = default;
+		};
+
+		struct ContentKeyHash
+		{
+			std::size_t operator () ( ContentKey const & key ) const { return key.hash ^ ( key.size * 0x9e3779b97f4a7c15 ); }
+		};
+
+		struct Entry
+		{
+			vk::Image image;
+			VmaAllocation allocation;
+			vk::ImageView view;
+
+			ContentKey contentKey;
+			uint32_t referenceCount { 0 };
+		};
+
+		// Maps the path to the file's texture, creating it and adding its upload unless another path loaded the same contents
+		Handle Insert ( std::string const & canonicalPath, TextureFile const &, std::vector <StagingRing::ImageUpload> & uploads );
+
+		Dependencies deps;
+
+		std::unordered_map < std::string, Handle > pathHandles;
+		std::unordered_map < ContentKey, Handle, ContentKeyHash > contentHandles;
+		std::unordered_map < Handle, Entry > entries;
+		Handle nextHandle { 0 };
+	};
+
+
+
+	// Implementation
+	inline vk::ImageView TextureCache::GetView ( Handle handle ) const { return entries.at ( handle ).view; }
+}
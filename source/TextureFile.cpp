@@ -0,0 +1,782 @@
+#include "TextureFile.hpp"
+#include "MappedFile.hpp"
+
+namespace pd
+{
+	namespace
+	{
+		constexpr uint32_t MakeFourCC ( char const ( & code ) [ 5 ] )
+		{
+			return static_cast < uint32_t > ( code [ 0 ] ) | static_cast < uint32_t > ( code [ 1 ] ) << 8
+				| static_cast < uint32_t > ( code [ 2 ] ) << 16 | static_cast < uint32_t > ( code [ 3 ] ) << 24;
+		}
+
+		// Marks transcoded files in the reserved part of their DDS header, bump the version whenever the encoder changes
+		constexpr uint32_t cacheTag { MakeFourCC ( "PDTX" ) };
+		constexpr uint32_t encoderVersion { 2 };
+
+		constexpr uint32_t ddsMagic { MakeFourCC ( "DDS " ) };
+		constexpr uint32_t ddsMipMapCountFlag { 0x20000 };
+		constexpr uint32_t ddsFourCCFlag { 0x4 };
+
+		constexpr uint8_t ktx2Identifier [ 12 ] { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+		struct DDSPixelFormat
+		{
+			uint32_t size;
+			uint32_t flags;
+			uint32_t fourCC;
+			uint32_t rgbBitCount;
+			uint32_t bitMasks [ 4 ];
+		};
+
+		struct DDSHeader
+		{
+			uint32_t size;
+			uint32_t flags;
+			uint32_t height;
+			uint32_t width;
+			uint32_t pitchOrLinearSize;
+			uint32_t depth;
+			uint32_t mipMapCount;
+
+			// Transcoded files keep the cache tag, encoder version and the source's hash and size here
+			uint32_t reserved1 [ 11 ];
+
+			DDSPixelFormat pixelFormat;
+			uint32_t caps;
+			uint32_t caps2;
+			uint32_t caps3;
+			uint32_t caps4;
+			uint32_t reserved2;
+		};
+
+		struct DDSHeaderDX10
+		{
+			uint32_t dxgiFormat;
+			uint32_t resourceDimension;
+			uint32_t miscFlag;
+			uint32_t arraySize;
+			uint32_t miscFlags2;
+		};
+
+		struct KTX2Header
+		{
+			uint8_t identifier [ 12 ];
+			uint32_t vkFormat;
+			uint32_t typeSize;
+			uint32_t pixelWidth;
+			uint32_t pixelHeight;
+			uint32_t pixelDepth;
+			uint32_t layerCount;
+			uint32_t faceCount;
+			uint32_t levelCount;
+			uint32_t supercompressionScheme;
+			uint32_t dfdByteOffset;
+			uint32_t dfdByteLength;
+			uint32_t kvdByteOffset;
+			uint32_t kvdByteLength;
+			uint64_t sgdByteOffset;
+			uint64_t sgdByteLength;
+		};
+
+		struct KTX2Level
+		{
+			uint64_t byteOffset;
+			uint64_t byteLength;
+			uint64_t uncompressedByteLength;
+		};
+
+		static_assert ( sizeof ( DDSHeader ) == 124 && sizeof ( DDSHeaderDX10 ) == 20 && sizeof ( KTX2Header ) == 80 );
+
+		struct DXGIFormat
+		{
+			uint32_t dxgiFormat;
+			vk::Format format;
+		};
+
+		constexpr DXGIFormat dxgiFormats []
+		{
+			{ 71, vk::Format::eBc1RgbaUnormBlock },
+			{ 72, vk::Format::eBc1RgbaSrgbBlock },
+			{ 77, vk::Format::eBc3UnormBlock },
+			{ 78, vk::Format::eBc3SrgbBlock },
+			{ 98, vk::Format::eBc7UnormBlock },
+			{ 99, vk::Format::eBc7SrgbBlock }
+		};
+
+		// Every level back to back, largest first
+		struct BlockImage
+		{
+			vk::Format format;
+			vk::Extent2D extent;
+			uint32_t mipLevels;
+			std::string_view data;
+
+			// Rows are stored top down unless a KTX2 file says otherwise
+			bool bottomUp { false };
+
+			DDSHeader ddsHeader {};
+		};
+
+		template < typename T >
+		T ReadAt ( std::string_view contents, std::size_t offset, std::string const & name )
+		{
+			if ( offset > contents.size () || contents.size () - offset < sizeof ( T ) )
+				throw std::runtime_error { "Texture " + name + " is truncated" };
+
+			T value;
+			std::memcpy ( &value, contents.data () + offset, sizeof ( T ) );
+
+			return value;
+		}
+
+		// FNV-1a, unlike std::hash the same for every build that reads the cache
+		uint64_t HashContents ( std::string_view contents )
+		{
+			uint64_t hash { 0xcbf29ce484222325 };
+
+			for ( auto character : contents )
+				hash = ( hash ^ static_cast <unsigned char> ( character ) ) * 0x100000001b3;
+
+			return hash;
+		}
+
+		vk::DeviceSize GetChainSize ( vk::Format format, vk::Extent2D extent, uint32_t mipLevels )
+		{
+			vk::DeviceSize size { 0 };
+
+			for ( uint32_t level { 0 }; level < mipLevels; ++level )
+				size += GetLevelSize ( format, GetMipLevelExtent ( extent, level ) );
+
+			return size;
+		}
+
+		void ValidateBlockImage ( BlockImage const & image, std::string const & name )
+		{
+			if ( image.extent.width == 0 || image.extent.height == 0 || image.mipLevels > GetMipLevelCount ( image.extent ) )
+				throw std::runtime_error { "Texture " + name + " has an invalid size" };
+
+			if ( image.data.size () < GetChainSize ( image.format, image.extent, image.mipLevels ) )
+				throw std::runtime_error { "Texture " + name + " is truncated" };
+		}
+
+		BlockImage ParseDDS ( std::string_view contents, std::string const & name )
+		{
+			if ( ReadAt <uint32_t> ( contents, 0, name ) != ddsMagic )
+				throw std::runtime_error { name + " isn't a DDS file" };
+
+			BlockImage image;
+			image.ddsHeader = ReadAt <DDSHeader> ( contents, sizeof ( uint32_t ), name );
+
+			auto const & header { image.ddsHeader };
+			auto dataOffset { sizeof ( uint32_t ) + sizeof ( DDSHeader ) };
+
+			if ( ! ( header.pixelFormat.flags & ddsFourCCFlag ) )
+				throw std::runtime_error { "DDS texture " + name + " isn't block compressed" };
+
+			// Files without a DX10 header don't say whether they are sRGB, like every other color texture they are taken to be
+			if ( header.pixelFormat.fourCC == MakeFourCC ( "DXT1" ) )
+				image.format = vk::Format::eBc1RgbaSrgbBlock;
+			else if ( header.pixelFormat.fourCC == MakeFourCC ( "DXT5" ) )
+				image.format = vk::Format::eBc3SrgbBlock;
+			else if ( header.pixelFormat.fourCC == MakeFourCC ( "DX10" ) )
+			{
+				auto headerDX10 { ReadAt <DDSHeaderDX10> ( contents, dataOffset, name ) };
+				dataOffset += sizeof ( DDSHeaderDX10 );
+
+				auto formatIt { std::ranges::find ( dxgiFormats, headerDX10.dxgiFormat, &DXGIFormat::dxgiFormat ) };
+
+				if ( formatIt == std::end ( dxgiFormats ) || headerDX10.arraySize > 1 )
+					throw std::runtime_error { "DDS texture " + name + " isn't a BC1, BC3 or BC7 2D texture" };
+
+				image.format = formatIt->format;
+			}
+			else
+				throw std::runtime_error { "DDS texture " + name + " isn't BC1, BC3 or BC7" };
+
+			image.extent = { header.width, header.height };
+			image.mipLevels = header.flags & ddsMipMapCountFlag ? std::max ( header.mipMapCount, 1u ) : 1;
+			image.data = contents.substr ( std::min ( dataOffset, contents.size () ) );
+
+			ValidateBlockImage ( image, name );
+
+			return image;
+		}
+
+		// KTX2 stores the smallest level first, when levels need reordering they are packed into packedData
+		BlockImage ParseKTX2 ( std::string_view contents, std::string const & name, std::string & packedData )
+		{
+			auto header { ReadAt <KTX2Header> ( contents, 0, name ) };
+
+			if ( std::memcmp ( header.identifier, ktx2Identifier, sizeof ( ktx2Identifier ) ) != 0 )
+				throw std::runtime_error { name + " isn't a KTX2 file" };
+
+			BlockImage image;
+			image.format = static_cast < vk::Format > ( header.vkFormat );
+			image.extent = { header.pixelWidth, header.pixelHeight };
+			image.mipLevels = std::max ( header.levelCount, 1u );
+
+			if ( ! GetBlockSize ( image.format ) || header.supercompressionScheme != 0 )
+				throw std::runtime_error { "KTX2 texture " + name + " isn't uncompressed BC1, BC3 or BC7" };
+
+			if ( header.pixelDepth > 0 || header.layerCount > 1 || header.faceCount != 1 )
+				throw std::runtime_error { "KTX2 texture " + name + " isn't a 2D texture" };
+
+			if ( image.mipLevels > GetMipLevelCount ( image.extent ) )
+				throw std::runtime_error { "Texture " + name + " has an invalid size" };
+
+			// Key and value pairs, each prefixed with its length and padded to four bytes
+			if ( header.kvdByteOffset > contents.size () || header.kvdByteLength > contents.size () - header.kvdByteOffset )
+				throw std::runtime_error { "KTX2 texture " + name + " has an invalid key and value block" };
+
+			for ( auto keyValues { contents.substr ( header.kvdByteOffset, header.kvdByteLength ) }; keyValues.size () >= sizeof ( uint32_t ); )
+			{
+				auto length { ReadAt <uint32_t> ( keyValues, 0, name ) };
+				auto keyValue { keyValues.substr ( sizeof ( uint32_t ), length ) };
+
+				if ( auto separator { keyValue.find ( '\0' ) }; keyValue.substr ( 0, separator ) == "KTXorientation" && separator != keyValue.npos )
+					image.bottomUp = keyValue.substr ( separator + 1 ).starts_with ( "ru" );
+
+				keyValues.remove_prefix ( std::min <std::size_t> ( keyValues.size (), sizeof ( uint32_t ) + ( ( length + 3ull ) & ~3ull ) ) );
+			}
+
+			std::vector <std::string_view> levels;
+			bool contiguous { true };
+
+			for ( uint32_t level { 0 }; level < image.mipLevels; ++level )
+			{
+				auto levelIndex { ReadAt <KTX2Level> ( contents, sizeof ( KTX2Header ) + level * sizeof ( KTX2Level ), name ) };
+
+				if ( levelIndex.byteOffset > contents.size () || levelIndex.byteLength > contents.size () - levelIndex.byteOffset
+					|| levelIndex.byteLength != GetLevelSize ( image.format, GetMipLevelExtent ( image.extent, level ) ) )
+					throw std::runtime_error { "KTX2 texture " + name + " has an invalid level index" };
+
+				levels.push_back ( contents.substr ( levelIndex.byteOffset, levelIndex.byteLength ) );
+
+				if ( level > 0 && levels [ level - 1 ].data () + levels [ level - 1 ].size () != levels [ level ].data () )
+					contiguous = false;
+			}
+
+			if ( contiguous )
+				image.data = { levels.front ().data (), static_cast < std::size_t > ( GetChainSize ( image.format, image.extent, image.mipLevels ) ) };
+			else
+			{
+				for ( auto level : levels )
+					packedData.append ( level );
+
+				image.data = packedData;
+			}
+
+			return image;
+		}
+
+		// Reverses the order of the block's first rows of texels, color indices take 8 bits a row and BC3 alpha indices 12
+		void FlipBlock ( unsigned char * block, bool bc1, uint32_t rows )
+		{
+			auto flipRows { [ rows ] ( uint64_t indices, unsigned int rowBits ) {
+				auto rowMask { ( uint64_t { 1 } << rowBits ) - 1 };
+				auto flipped { indices };
+
+				for ( uint32_t row { 0 }; row < rows; ++row )
+				{
+					flipped &= ~( rowMask << ( rows - 1 - row ) * rowBits );
+					flipped |= ( indices >> row * rowBits & rowMask ) << ( rows - 1 - row ) * rowBits;
+				}
+
+				return flipped;
+			} };
+
+			if ( ! bc1 )
+			{
+				uint64_t alpha;
+				std::memcpy ( &alpha, block, 8 );
+				alpha = ( alpha & 0xFFFF ) | flipRows ( alpha >> 16, 12 ) << 16;
+				std::memcpy ( block, &alpha, 8 );
+				block += 8;
+			}
+
+			uint32_t indices;
+			std::memcpy ( &indices, block + 4, 4 );
+			indices = static_cast < uint32_t > ( flipRows ( indices, 8 ) );
+			std::memcpy ( block + 4, &indices, 4 );
+		}
+
+		// Turns a top down image bottom up, as decoded images are. Blocks can only be flipped whole, so the chain stops
+		// before the first level taller than a block that isn't a whole number of blocks tall
+		void FlipBlockImage ( BlockImage & image, std::string const & name, std::vector <unsigned char> & flippedData )
+		{
+			auto blockSize { GetBlockSize ( image.format ) };
+			auto bc1 { blockSize == 8 };
+
+			if ( ! bc1 && image.format != vk::Format::eBc3SrgbBlock && image.format != vk::Format::eBc3UnormBlock )
+				throw std::runtime_error { "BC7 texture " + name + " is stored top down and can't be flipped here, store it as KTX2 with a KTXorientation of ru" };
+
+			auto flippable { [] ( vk::Extent2D extent ) { return extent.height <= 4 || extent.height % 4 == 0; } };
+
+			if ( ! flippable ( image.extent ) )
+				throw std::runtime_error { "Texture " + name + " is stored top down and isn't a whole number of blocks tall, so can't be flipped" };
+
+			uint32_t mipLevels { 0 };
+
+			while ( mipLevels < image.mipLevels && flippable ( GetMipLevelExtent ( image.extent, mipLevels ) ) )
+				++mipLevels;
+
+			flippedData.resize ( GetChainSize ( image.format, image.extent, mipLevels ) );
+
+			auto source { reinterpret_cast < unsigned char const * > ( image.data.data () ) };
+			auto output { flippedData.data () };
+
+			for ( uint32_t level { 0 }; level < mipLevels; ++level )
+			{
+				auto extent { GetMipLevelExtent ( image.extent, level ) };
+				auto rowSize { static_cast < std::size_t > ( ( extent.width + 3 ) / 4 ) * blockSize };
+				auto blockRows { ( extent.height + 3 ) / 4 };
+
+				for ( uint32_t blockRow { 0 }; blockRow < blockRows; ++blockRow )
+				{
+					auto row { output + ( blockRows - 1 - blockRow ) * rowSize };
+					std::memcpy ( row, source + blockRow * rowSize, rowSize );
+
+					for ( auto block { row }; block < row + rowSize; block += blockSize )
+						FlipBlock ( block, bc1, std::min ( extent.height, 4u ) );
+				}
+
+				source += rowSize * blockRows;
+				output += rowSize * blockRows;
+			}
+
+			image.mipLevels = mipLevels;
+			image.data = { reinterpret_cast < char const * > ( flippedData.data () ), flippedData.size () };
+			image.bottomUp = true;
+		}
+
+		uint16_t EncodeRGB565 ( glm::vec3 color )
+		{
+			auto quantize { [] ( float value, int maximum ) {
+				return static_cast < uint16_t > ( std::clamp ( static_cast < int > ( value / 255.0f * maximum + 0.5f ), 0, maximum ) );
+			} };
+
+			return static_cast < uint16_t > ( quantize ( color.r, 31 ) << 11 | quantize ( color.g, 63 ) << 5 | quantize ( color.b, 31 ) );
+		}
+
+		glm::vec3 DecodeRGB565 ( uint16_t color )
+		{
+			auto red { color >> 11 & 31 }, green { color >> 5 & 63 }, blue { color & 31 };
+
+			return { static_cast < float > ( red << 3 | red >> 2 ), static_cast < float > ( green << 2 | green >> 4 ),
+				static_cast < float > ( blue << 3 | blue >> 2 ) };
+		}
+
+		// Endpoints at the extremes of the block along its principal axis, four color mode
+		void EncodeColorBlock ( glm::vec3 const ( & texels ) [ 16 ], unsigned char * output )
+		{
+			glm::vec3 mean { 0.0f };
+
+			for ( auto const & texel : texels )
+				mean += texel / 16.0f;
+
+			glm::mat3 covariance { 0.0f };
+
+			for ( auto const & texel : texels )
+				covariance += glm::outerProduct ( texel - mean, texel - mean );
+
+			// Power iteration, starting from the bounding box diagonal
+			auto minimum { texels [ 0 ] }, maximum { texels [ 0 ] };
+
+			for ( auto const & texel : texels )
+			{
+				minimum = glm::min ( minimum, texel );
+				maximum = glm::max ( maximum, texel );
+			}
+
+			auto axis { maximum - minimum };
+
+			for ( int iteration { 0 }; iteration < 4 && glm::dot ( axis, axis ) > 1e-6f; ++iteration )
+				axis = glm::normalize ( covariance * axis );
+
+			auto low { mean }, high { mean };
+
+			if ( glm::dot ( axis, axis ) > 1e-6f )
+			{
+				axis = glm::normalize ( axis );
+
+				float lowProjection { 0.0f }, highProjection { 0.0f };
+
+				for ( auto const & texel : texels )
+				{
+					auto projection { glm::dot ( texel - mean, axis ) };
+					lowProjection = std::min ( lowProjection, projection );
+					highProjection = std::max ( highProjection, projection );
+				}
+
+				low = mean + axis * lowProjection;
+				high = mean + axis * highProjection;
+			}
+
+			auto color0 { EncodeRGB565 ( high ) }, color1 { EncodeRGB565 ( low ) };
+
+			if ( color0 < color1 )
+				std::swap ( color0, color1 );
+
+			uint32_t indices { 0 };
+
+			// Equal endpoints would select three color mode, index 0 is still the color itself
+			if ( color0 != color1 )
+			{
+				auto endpoint0 { DecodeRGB565 ( color0 ) }, endpoint1 { DecodeRGB565 ( color1 ) };
+				glm::vec3 palette [ 4 ] { endpoint0, endpoint1, ( endpoint0 * 2.0f + endpoint1 ) / 3.0f, ( endpoint0 + endpoint1 * 2.0f ) / 3.0f };
+
+				for ( int texel { 0 }; texel < 16; ++texel )
+				{
+					uint32_t closest { 0 };
+					float closestDistance { std::numeric_limits <float>::max () };
+
+					for ( uint32_t index { 0 }; index < 4; ++index )
+					{
+						auto difference { texels [ texel ] - palette [ index ] };
+
+						if ( auto distance { glm::dot ( difference, difference ) }; distance < closestDistance )
+						{
+							closest = index;
+							closestDistance = distance;
+						}
+					}
+
+					indices |= closest << ( texel * 2 );
+				}
+			}
+
+			std::memcpy ( output, &color0, 2 );
+			std::memcpy ( output + 2, &color1, 2 );
+			std::memcpy ( output + 4, &indices, 4 );
+		}
+
+		void GetAlphaPalette ( unsigned char alpha0, unsigned char alpha1, unsigned int ( & palette ) [ 8 ] )
+		{
+			palette [ 0 ] = alpha0;
+			palette [ 1 ] = alpha1;
+
+			if ( alpha0 > alpha1 )
+			{
+				for ( unsigned int index { 1 }; index < 7; ++index )
+					palette [ index + 1 ] = ( ( 7 - index ) * alpha0 + index * alpha1 + 3 ) / 7;
+			}
+			else
+			{
+				for ( unsigned int index { 1 }; index < 5; ++index )
+					palette [ index + 1 ] = ( ( 5 - index ) * alpha0 + index * alpha1 + 2 ) / 5;
+
+				palette [ 6 ] = 0;
+				palette [ 7 ] = 255;
+			}
+		}
+
+		// Endpoints at the block's alpha range, eight value mode
+		void EncodeAlphaBlock ( unsigned char const ( & alphas ) [ 16 ], unsigned char * output )
+		{
+			auto [ minimum, maximum ] { std::ranges::minmax ( alphas ) };
+
+			uint64_t block { static_cast < uint64_t > ( maximum ) | static_cast < uint64_t > ( minimum ) << 8 };
+
+			if ( maximum != minimum )
+			{
+				unsigned int palette [ 8 ];
+				GetAlphaPalette ( maximum, minimum, palette );
+
+				for ( int texel { 0 }; texel < 16; ++texel )
+				{
+					uint64_t closest { 0 };
+
+					for ( uint64_t index { 1 }; index < 8; ++index )
+					{
+						auto distance { [ & ] ( uint64_t paletteIndex ) { return std::abs ( static_cast < int > ( palette [ paletteIndex ] ) - alphas [ texel ] ); } };
+
+						if ( distance ( index ) < distance ( closest ) )
+							closest = index;
+					}
+
+					block |= closest << ( 16 + texel * 3 );
+				}
+			}
+
+			std::memcpy ( output, &block, 8 );
+		}
+
+		void EncodeLevel ( unsigned char const * pixels, vk::Extent2D extent, bool alpha, unsigned char * output )
+		{
+			for ( uint32_t blockY { 0 }; blockY < ( extent.height + 3 ) / 4; ++blockY )
+			{
+				for ( uint32_t blockX { 0 }; blockX < ( extent.width + 3 ) / 4; ++blockX )
+				{
+					glm::vec3 colors [ 16 ];
+					unsigned char alphas [ 16 ];
+
+					// Blocks overhanging small levels repeat the edge texels
+					for ( uint32_t texel { 0 }; texel < 16; ++texel )
+					{
+						auto x { std::min ( blockX * 4 + texel % 4, extent.width - 1 ) };
+						auto y { std::min ( blockY * 4 + texel / 4, extent.height - 1 ) };
+						auto source { pixels + ( static_cast < std::size_t > ( y ) * extent.width + x ) * 4 };
+
+						colors [ texel ] = { source [ 0 ], source [ 1 ], source [ 2 ] };
+						alphas [ texel ] = source [ 3 ];
+					}
+
+					if ( alpha )
+					{
+						EncodeAlphaBlock ( alphas, output );
+						output += 8;
+					}
+
+					EncodeColorBlock ( colors, output );
+					output += 8;
+				}
+			}
+		}
+
+		void DecodeLevel ( BlockImage const & image, std::string const & name, unsigned char * pixels )
+		{
+			auto bc1 { GetBlockSize ( image.format ) == 8 };
+
+			if ( ! bc1 && image.format != vk::Format::eBc3SrgbBlock && image.format != vk::Format::eBc3UnormBlock )
+				throw std::runtime_error { "Texture " + name + " is BC7, which the device can't sample and can't be decoded here" };
+
+			auto block { reinterpret_cast < unsigned char const * > ( image.data.data () ) };
+
+			for ( uint32_t blockY { 0 }; blockY < ( image.extent.height + 3 ) / 4; ++blockY )
+			{
+				for ( uint32_t blockX { 0 }; blockX < ( image.extent.width + 3 ) / 4; ++blockX )
+				{
+					unsigned int alphaPalette [ 8 ] {};
+					uint64_t alphaIndices { 0 };
+
+					if ( ! bc1 )
+					{
+						GetAlphaPalette ( block [ 0 ], block [ 1 ], alphaPalette );
+						std::memcpy ( &alphaIndices, block, 8 );
+						alphaIndices >>= 16;
+						block += 8;
+					}
+
+					uint16_t color0, color1;
+					uint32_t indices;
+					std::memcpy ( &color0, block, 2 );
+					std::memcpy ( &color1, block + 2, 2 );
+					std::memcpy ( &indices, block + 4, 4 );
+					block += 8;
+
+					auto endpoint0 { DecodeRGB565 ( color0 ) }, endpoint1 { DecodeRGB565 ( color1 ) };
+					glm::vec4 palette [ 4 ] { glm::vec4 { endpoint0, 255.0f }, glm::vec4 { endpoint1, 255.0f } };
+
+					// BC1 switches to three colors and transparent black when the endpoints are ordered low to high
+					if ( color0 > color1 || ! bc1 )
+					{
+						palette [ 2 ] = ( palette [ 0 ] * 2.0f + palette [ 1 ] ) / 3.0f;
+						palette [ 3 ] = ( palette [ 0 ] + palette [ 1 ] * 2.0f ) / 3.0f;
+					}
+					else
+					{
+						palette [ 2 ] = ( palette [ 0 ] + palette [ 1 ] ) / 2.0f;
+						palette [ 3 ] = glm::vec4 { 0.0f };
+					}
+
+					for ( uint32_t texel { 0 }; texel < 16; ++texel )
+					{
+						auto x { blockX * 4 + texel % 4 };
+						auto y { blockY * 4 + texel / 4 };
+
+						if ( x >= image.extent.width || y >= image.extent.height )
+							continue;
+
+						auto color { palette [ indices >> ( texel * 2 ) & 3 ] };
+
+						if ( ! bc1 )
+							color.a = static_cast < float > ( alphaPalette [ alphaIndices >> ( texel * 3 ) & 7 ] );
+
+						auto output { pixels + ( static_cast < std::size_t > ( y ) * image.extent.width + x ) * 4 };
+
+						for ( int component { 0 }; component < 4; ++component )
+							output [ component ] = static_cast < unsigned char > ( color [ component ] + 0.5f );
+					}
+				}
+			}
+		}
+
+		bool CanSample ( vk::PhysicalDevice physicalDevice, vk::Format format )
+		{
+			vk::FormatFeatureFlags requiredFeatures { vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear };
+			return ( physicalDevice.getFormatProperties ( format ).optimalTilingFeatures & requiredFeatures ) == requiredFeatures;
+		}
+
+		std::filesystem::path GetCachePath ( std::filesystem::path const & path )
+		{
+			return std::filesystem::path { path } += ".bc.dds";
+		}
+
+		std::optional <TextureFile> ReadCache ( std::filesystem::path const & cachePath, std::size_t sourceHash, std::size_t sourceSize )
+		{
+			if ( ! std::filesystem::exists ( cachePath ) )
+				return {};
+
+			auto file { std::make_shared <MappedFile> ( cachePath ) };
+			auto image { ParseDDS ( file->GetContents (), cachePath.generic_string () ) };
+
+			auto const & reserved { image.ddsHeader.reserved1 };
+			auto hash { static_cast < uint64_t > ( reserved [ 3 ] ) << 32 | reserved [ 2 ] };
+			auto size { static_cast < uint64_t > ( reserved [ 5 ] ) << 32 | reserved [ 4 ] };
+
+			if ( reserved [ 0 ] != cacheTag || reserved [ 1 ] != encoderVersion || hash != static_cast < uint64_t > ( sourceHash )
+				|| size != static_cast < uint64_t > ( sourceSize ) )
+				return {};
+
+			return TextureFile { image.format, image.extent, image.mipLevels, image.data.data (), file, sourceHash, sourceSize };
+		}
+
+		void WriteCache ( std::filesystem::path const & cachePath, TextureFile const & texture, vk::DeviceSize size )
+		{
+			DDSHeader header {};
+			header.size = sizeof ( DDSHeader );
+			header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | ddsMipMapCountFlag | 0x80000;
+			header.height = texture.extent.height;
+			header.width = texture.extent.width;
+			header.pitchOrLinearSize = static_cast < uint32_t > ( GetLevelSize ( texture.format, texture.extent ) );
+			header.mipMapCount = texture.mipLevels;
+			header.reserved1 [ 0 ] = cacheTag;
+			header.reserved1 [ 1 ] = encoderVersion;
+			header.reserved1 [ 2 ] = static_cast < uint32_t > ( static_cast < uint64_t > ( texture.hash ) );
+			header.reserved1 [ 3 ] = static_cast < uint32_t > ( static_cast < uint64_t > ( texture.hash ) >> 32 );
+			header.reserved1 [ 4 ] = static_cast < uint32_t > ( static_cast < uint64_t > ( texture.size ) );
+			header.reserved1 [ 5 ] = static_cast < uint32_t > ( static_cast < uint64_t > ( texture.size ) >> 32 );
+			header.pixelFormat = { sizeof ( DDSPixelFormat ), ddsFourCCFlag, MakeFourCC ( "DX10" ), 0, {} };
+
+			// Texture, mipmaps and complex
+			header.caps = 0x1000 | 0x400000 | 0x8;
+
+			auto formatIt { std::ranges::find ( dxgiFormats, texture.format, &DXGIFormat::format ) };
+			DDSHeaderDX10 headerDX10 { formatIt->dxgiFormat, 3, 0, 1, 0 };
+
+			WriteFileAtomically ( cachePath, { std::as_bytes ( std::span { &ddsMagic, 1 } ), std::as_bytes ( std::span { &header, 1 } ),
+				std::as_bytes ( std::span { &headerDX10, 1 } ), { static_cast < std::byte const * > ( texture.data ), static_cast < std::size_t > ( size ) } } );
+		}
+
+		std::shared_ptr <unsigned char const> DecodeImage ( std::string_view contents, std::string const & name, vk::Extent2D & extent )
+		{
+			int width, height;
+
+			auto pixels { stbi_load_from_memory ( reinterpret_cast < stbi_uc const * > ( contents.data () ),
+				static_cast < int > ( contents.size () ), &width, &height, nullptr, 4 ) };
+
+			if ( ! pixels )
+				throw std::runtime_error { "Couldn't decode texture " + name + ": " + stbi_failure_reason () };
+
+			extent = { static_cast < uint32_t > ( width ), static_cast < uint32_t > ( height ) };
+
+			return { pixels, stbi_image_free };
+		}
+
+		// Encodes the image and the mip chain generated from it
+		TextureFile TranscodeImage ( unsigned char const * pixels, vk::Extent2D extent, std::size_t hash, std::size_t size )
+		{
+			auto pixelCount { static_cast < std::size_t > ( extent.width ) * extent.height };
+			auto alpha { false };
+
+			for ( std::size_t pixel { 0 }; pixel < pixelCount && ! alpha; ++pixel )
+				alpha = pixels [ pixel * 4 + 3 ] != 255;
+
+			auto format { alpha ? vk::Format::eBc3SrgbBlock : vk::Format::eBc1RgbaSrgbBlock };
+			auto mipLevels { GetMipLevelCount ( extent ) };
+
+			auto encoded { std::make_shared < std::vector <unsigned char> > ( GetChainSize ( format, extent, mipLevels ) ) };
+			auto output { encoded->data () };
+
+			std::vector <unsigned char> level { pixels, pixels + pixelCount * 4 }, nextLevel;
+
+			for ( uint32_t levelIndex { 0 }; levelIndex < mipLevels; ++levelIndex )
+			{
+				auto levelExtent { GetMipLevelExtent ( extent, levelIndex ) };
+
+				EncodeLevel ( level.data (), levelExtent, alpha, output );
+				output += GetLevelSize ( format, levelExtent );
+
+				if ( levelIndex + 1 == mipLevels )
+					break;
+
+				auto nextExtent { GetMipLevelExtent ( extent, levelIndex + 1 ) };
+				nextLevel.resize ( static_cast < std::size_t > ( nextExtent.width ) * nextExtent.height * 4 );
+				DownsampleImage ( level.data (), levelExtent, nextLevel.data (), nextExtent, 4 );
+
+				std::swap ( level, nextLevel );
+			}
+
+			return { format, extent, mipLevels, encoded->data (), encoded, hash, size };
+		}
+	}
+
+	TextureFile LoadTextureFile ( vk::PhysicalDevice physicalDevice, std::filesystem::path const & path )
+	{
+		auto name { path.generic_string () };
+
+		auto file { std::make_shared <MappedFile> ( path ) };
+		auto contents { file->GetContents () };
+		auto hash { static_cast <std::size_t> ( HashContents ( contents ) ) };
+		auto size { contents.size () };
+
+		auto extension { path.extension ().string () };
+		std::ranges::transform ( extension, extension.begin (), [] ( unsigned char character ) { return static_cast < char > ( std::tolower ( character ) ); } );
+
+		if ( extension == ".dds" || extension == ".ktx2" )
+		{
+			auto packedData { std::make_shared <std::string> () };
+			auto image { extension == ".dds" ? ParseDDS ( contents, name ) : ParseKTX2 ( contents, name, *packedData ) };
+
+			std::shared_ptr <void const> storage { packedData->empty () ? std::shared_ptr <void const> { file } : packedData };
+
+			if ( ! image.bottomUp )
+			{
+				auto flippedData { std::make_shared < std::vector <unsigned char> > () };
+				FlipBlockImage ( image, name, *flippedData );
+				storage = flippedData;
+			}
+
+			if ( CanSample ( physicalDevice, image.format ) )
+				return { image.format, image.extent, image.mipLevels, image.data.data (), storage, hash, size };
+
+			// Decode the first level, the mips are generated again on upload
+			auto pixels { std::make_shared < std::vector <unsigned char> > ( static_cast < std::size_t > ( image.extent.width ) * image.extent.height * 4 ) };
+			DecodeLevel ( image, name, pixels->data () );
+
+			return { vk::Format::eR8G8B8A8Srgb, image.extent, GetMipLevelCount ( image.extent ), pixels->data (), pixels, hash, size };
+		}
+
+		auto transcode { CanSample ( physicalDevice, vk::Format::eBc1RgbaSrgbBlock ) && CanSample ( physicalDevice, vk::Format::eBc3SrgbBlock ) };
+		auto cachePath { GetCachePath ( path ) };
+
+		if ( transcode )
+		{
+			try
+			{
+				if ( auto cached { ReadCache ( cachePath, hash, size ) } )
+					return std::move ( *cached );
+			}
+			catch ( std::exception const & exception )
+			{
+				std::cout << "Ignoring texture cache " << cachePath.generic_string () << ": " << exception.what () << std::endl;
+			}
+		}
+
+		vk::Extent2D extent;
+		auto pixels { DecodeImage ( contents, name, extent ) };
+
+		if ( ! transcode )
+			return { vk::Format::eR8G8B8A8Srgb, extent, GetMipLevelCount ( extent ), pixels.get (), pixels, hash, size };
+
+		auto texture { TranscodeImage ( pixels.get (), extent, hash, size ) };
+
+		TryWriteCache ( "texture", cachePath, [ & ] () {
+			WriteCache ( cachePath, texture, GetChainSize ( texture.format, texture.extent, texture.mipLevels ) );
+		} );
+
+		return texture;
+	}
+}
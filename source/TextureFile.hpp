@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Core.hpp"
+
+/*
+	Texture files read into the form they are uploaded in. DDS and KTX2 files holding BC1, BC3
+	or BC7 blocks are uploaded as they are. Where the device samples BC formats, other images
+	are encoded to BC1, or BC3 if any texel is translucent, once and cached next to the source
+	in a DDS file. Anything the device can't sample compressed is decoded to RGBA.
+
+	Every texture is uploaded bottom row first, as stb_image is set to decode. DDS files, and
+	KTX2 files unless their KTXorientation is ru, are stored top down and their BC1 and BC3
+	blocks are flipped on load. BC7 textures can't be flipped and must be stored bottom up.
+*/
+
+namespace pd
+{
+	struct TextureFile
+	{
+		vk::Format format;
+		vk::Extent2D extent;
+		uint32_t mipLevels;
+
+		// Laid out as StagingRing::ImageUpload expects for the format
+		void const * data;
+
+		// Owns what data points at
+		std::shared_ptr <void const> storage;
+
+		// Hash and size of the file contents, together the same for identical files wherever they are
+		std::size_t hash;
+		std::size_t size;
+	};
+
+	TextureFile LoadTextureFile ( vk::PhysicalDevice, std::filesystem::path const & );
+}